@@ -0,0 +1,188 @@
+// Runtime benchmark for the optimization levels: compiles a game of life program at
+// every -O level, links it with cc and times how long the binary takes to step a
+// large board. The program's exit code is a checksum of the final board, which has
+// to come out the same at every level.
+#include "ast.h"
+#include "codegen.h"
+#include "compiler.h"
+#include "parse.h"
+#include "scan.h"
+#include "typecheck.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <llvm-c/Core.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+
+#define RUNS 3
+
+static const char *gol =
+	"proto malloc: (size: usize) -> void*;\n"
+	"\n"
+	"let board: struct = {\n"
+	"	cells: i32*;\n"
+	"	scratch: i32*;\n"
+	"	width: i32;\n"
+	"};\n"
+	"\n"
+	"let at: (b: struct board*, x: i32, y: i32) -> i32 = {\n"
+	"	if (x < 0 || x >= b->width || y < 0 || y >= b->width) {\n"
+	"		return 0;\n"
+	"	}\n"
+	"	return b->cells[y * b->width + x];\n"
+	"};\n"
+	"\n"
+	"let step: (b: struct board*) -> void = {\n"
+	"	let y: i32 = 0;\n"
+	"	while (y < b->width) {\n"
+	"		let x: i32 = 0;\n"
+	"		while (x < b->width) {\n"
+	"			let n: i32 = at(b, x - 1, y - 1) + at(b, x, y - 1) + at(b, x + 1, y - 1)\n"
+	"				+ at(b, x - 1, y) + at(b, x + 1, y)\n"
+	"				+ at(b, x - 1, y + 1) + at(b, x, y + 1) + at(b, x + 1, y + 1);\n"
+	"			let alive: i32 = 0;\n"
+	"			if (n == 3 || (n == 2 && at(b, x, y) == 1)) {\n"
+	"				alive = 1;\n"
+	"			}\n"
+	"			b->scratch[y * b->width + x] = alive;\n"
+	"			x += 1;\n"
+	"		}\n"
+	"		y += 1;\n"
+	"	}\n"
+	"	let tmp: i32* = b->cells;\n"
+	"	b->cells = b->scratch;\n"
+	"	b->scratch = tmp;\n"
+	"};\n"
+	"\n"
+	"let main: () -> i32 = {\n"
+	"	let width: i32 = 512;\n"
+	"	let steps: i32 = 40;\n"
+	"	let b: struct board;\n"
+	"	b.width = width;\n"
+	"	b.cells = malloc(cast(width * width * 4, usize));\n"
+	"	b.scratch = malloc(cast(width * width * 4, usize));\n"
+	"	let seed: i64 = 42;\n"
+	"	let i: i32 = 0;\n"
+	"	while (i < width * width) {\n"
+	"		seed = (seed * 1103515245 + 12345) % 2147483648;\n"
+	"		b.cells[i] = cast(seed / 65536 % 2, i32);\n"
+	"		i += 1;\n"
+	"	}\n"
+	"	i = 0;\n"
+	"	while (i < steps) {\n"
+	"		step(&b);\n"
+	"		i += 1;\n"
+	"	}\n"
+	"	let count: i32 = 0;\n"
+	"	i = 0;\n"
+	"	while (i < width * width) {\n"
+	"		count += b.cells[i];\n"
+	"		i += 1;\n"
+	"	}\n"
+	"	return count % 256;\n"
+	"};\n";
+
+static const struct {
+	opt_level_t level;
+	const char *name;
+} levels[] = {
+	{OPT_O0, "-O0"},
+	{OPT_O1, "-O1"},
+	{OPT_O2, "-O2"},
+	{OPT_O3, "-O3"},
+	{OPT_OS, "-Os"},
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Compiles gol at `level` into the object file `obj`. Returns the compile time.
+static double compile(opt_level_t level, char *obj)
+{
+	source src = {(char *)gol, strlen(gol), 0};
+	compile_ctx *c = compile_ctx_init();
+	LLVMContextRef ctxt = LLVMContextCreate();
+	char *error = NULL;
+	double start = now();
+
+	c->opt_level = level;
+	token_list *toks = scan(c, &src);
+	ast_decl *program = parse_program(c, toks);
+	typecheck_program(c, program);
+	if (c->had_error) {
+		fprintf(stderr, "bench_opt: gol failed to compile\n");
+		exit(1);
+	}
+	LLVMModuleRef mod = module_codegen(c, ctxt, program, "gol");
+	module_optimize(c, mod);
+	if (LLVMTargetMachineEmitToFile(c->tm, mod, obj, LLVMObjectFile, &error)) {
+		fprintf(stderr, "bench_opt: %s\n", error);
+		exit(1);
+	}
+	double elapsed = now() - start;
+
+	LLVMDisposeModule(mod);
+	LLVMContextDispose(ctxt);
+	compile_ctx_destroy(c);
+	tok_list_destroy(toks);
+	return elapsed;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/bench_opt.XXXXXX";
+	char obj[64];
+	char bin[64];
+	char cmd[256];
+	int expected = -1;
+
+	if (mkdtemp(dir) == NULL) {
+		perror("bench_opt: mkdtemp");
+		return 1;
+	}
+	snprintf(obj, sizeof(obj), "%s/gol.o", dir);
+	snprintf(bin, sizeof(bin), "%s/gol", dir);
+	LLVMInitializeNativeTarget();
+	LLVMInitializeNativeAsmPrinter();
+
+	for (size_t l = 0 ; l < sizeof(levels) / sizeof(*levels) ; ++l) {
+		double compile_time = compile(levels[l].level, obj);
+		double best = 1e9;
+		int status = 0;
+
+		snprintf(cmd, sizeof(cmd), "cc %s -o %s", obj, bin);
+		if (system(cmd) != 0) {
+			fprintf(stderr, "bench_opt: linking failed\n");
+			return 1;
+		}
+		for (int r = 0 ; r < RUNS ; ++r) {
+			double start = now();
+			status = system(bin);
+			double elapsed = now() - start;
+			if (elapsed < best)
+				best = elapsed;
+		}
+		if (!WIFEXITED(status) || (expected != -1 && WEXITSTATUS(status) != expected)) {
+			fprintf(stderr, "bench_opt: gol built with %s gave the wrong result\n", levels[l].name);
+			return 1;
+		}
+		expected = WEXITSTATUS(status);
+		printf("bench_opt: gol 512x512, 40 steps, %s: compile %.2f ms, best run of %d: %.2f ms\n",
+				levels[l].name, compile_time * 1e3, RUNS, best * 1e3);
+	}
+	unlink(obj);
+	unlink(bin);
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Parser micro-benchmark: parses a generated, expression-dense source over and
+// over and reports the best time seen. Scanning is done once, up front.
+#include "ast.h"
+#include "compiler.h"
+#include "parse.h"
+#include "scan.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TARGET_SIZE (8 * 1024 * 1024)
+#define RUNS 10
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append_str(strvec *s, const char *str)
+{
+	for (; *str ; ++str)
+		strvec_append(s, *str);
+}
+
+// Functions full of arithmetic/logic over a handful of locals, mixing every
+// precedence level with parens and unary operators.
+static strvec *gen_source(void)
+{
+	static const char *exprs[] = {
+		"a + b * c - d / 3 % 7",
+		"(a << 2) + (b >> 1) - c * (d + 1)",
+		"a & b | c ^ d & 255",
+		"-a + ~b * (c - -d)",
+		"a * b + c * d + a * c + b * d",
+		"((a + 1) * (b + 2) - (c + 3)) / (d + 4)",
+	};
+	static const char *conds[] = {
+		"a < b && c >= d || a == 10",
+		"!(a > b) || c <= d && b != 3",
+	};
+	size_t nexprs = sizeof(exprs) / sizeof(*exprs);
+	size_t nconds = sizeof(conds) / sizeof(*conds);
+	strvec *ret = strvec_init(TARGET_SIZE);
+	char line[256];
+
+	for (size_t n = 0 ; ret->size < TARGET_SIZE ; ++n) {
+		snprintf(line, sizeof(line), "let f%zu: (a: i32, b: i32, c: i32, d: i32) -> i32 = {\n", n);
+		append_str(ret, line);
+		for (size_t i = 0 ; i < 8 ; ++i) {
+			snprintf(line, sizeof(line), "\tlet x%zu: i32 = %s;\n", i, exprs[(n + i) % nexprs]);
+			append_str(ret, line);
+			snprintf(line, sizeof(line), "\tif (%s) {\n\t\ta += x%zu;\n\t}\n", conds[(n + i) % nconds], i);
+			append_str(ret, line);
+		}
+		append_str(ret, "\treturn a + b + c + d;\n};\n");
+	}
+	return ret;
+}
+
+int main(void)
+{
+	strvec *text = gen_source();
+	source src = {text->text, text->size - 1, 0};
+	token_list *toks;
+	double best = 1e9;
+	compile_ctx *c = compile_ctx_init();
+
+	toks = scan(c, &src);
+	for (int r = 0 ; r < RUNS ; ++r) {
+		double start = now();
+		parse_program(c, toks);
+		double elapsed = now() - start;
+		if (elapsed < best)
+			best = elapsed;
+		// Keep the interned identifiers (the tokens point to them), drop the AST.
+		compile_ctx_drop_ast(c);
+	}
+	printf("bench_parse: %zu bytes, %zu tokens, best of %d: %.2f ms (%.1f Mtok/s)\n",
+			src.size, toks->size, RUNS, best * 1e3, toks->size / best / 1e6);
+	tok_list_destroy(toks);
+	strvec_destroy(text);
+	compile_ctx_destroy(c);
+	return 0;
+}
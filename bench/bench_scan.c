@@ -0,0 +1,71 @@
+// Scanner micro-benchmark: scans a generated, identifier-heavy source over and
+// over and reports the best throughput seen.
+#include "compiler.h"
+#include "scan.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TARGET_SIZE (8 * 1024 * 1024)
+#define RUNS 10
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Mostly identifiers, some of which share a prefix/length with keywords
+// so the keyword check can't bail out on the first character alone.
+// Lines are indented and every fourth one carries a comment, like real code.
+static strvec *gen_source(void)
+{
+	static const char *words[] = {
+		"width", "board", "scratch", "i", "j", "neighbors", "step", "init_board",
+		"letter", "iffy", "whiles", "return_value", "structure", "u32_count",
+		"constant", "breakage", "charlie", "nullable", "voidness", "truthy",
+	};
+	size_t nwords = sizeof(words) / sizeof(*words);
+	strvec *ret = strvec_init(TARGET_SIZE);
+	size_t n = 0;
+	char line[256];
+
+	while (ret->size < TARGET_SIZE) {
+		int len = snprintf(line, sizeof(line), "\t\tlet %s_%zu: i32 = %s + %s * %s;%s\n",
+				words[n % nwords], n, words[(n * 7) % nwords],
+				words[(n * 3) % nwords], words[(n * 11) % nwords],
+				n % 4 ? "" : " // keep the neighbour count in range of the board width");
+		for (int k = 0 ; k < len ; ++k)
+			strvec_append(ret, line[k]);
+		++n;
+	}
+	return ret;
+}
+
+int main(void)
+{
+	strvec *text = gen_source();
+	source src = {text->text, text->size - 1, 0};
+	size_t ntoks = 0;
+	double best = 1e9;
+	compile_ctx *c = compile_ctx_init();
+
+	for (int r = 0 ; r < RUNS ; ++r) {
+		double start = now();
+		token_list *toks = scan(c, &src);
+		double elapsed = now() - start;
+		if (elapsed < best)
+			best = elapsed;
+		ntoks = toks->size;
+		tok_list_destroy(toks);
+	}
+	printf("bench_scan: %zu bytes, %zu tokens, best of %d: %.2f ms (%.1f MB/s)\n",
+			src.size, ntoks, RUNS, best * 1e3, src.size / best / (1024 * 1024));
+	strvec_destroy(text);
+	compile_ctx_destroy(c);
+	return 0;
+}
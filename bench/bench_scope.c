@@ -0,0 +1,108 @@
+// Symbol table stress benchmark: typechecks and generates code for functions made of
+// deeply nested blocks, where every level looks up names bound in the outermost scopes.
+#include "ast.h"
+#include "codegen.h"
+#include "compiler.h"
+#include "parse.h"
+#include "scan.h"
+#include "typecheck.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GLOBALS 16
+#define FUNCTIONS 64
+#define DEPTH 256
+#define RUNS 10
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append_str(strvec *s, const char *str)
+{
+	for (; *str ; ++str)
+		strvec_append(s, *str);
+}
+
+static void indent(strvec *s, size_t depth)
+{
+	for (size_t i = 0 ; i < depth ; ++i)
+		strvec_append(s, '\t');
+}
+
+static strvec *gen_source(void)
+{
+	strvec *ret = strvec_init(1024 * 1024);
+	char line[256];
+
+	for (size_t g = 0 ; g < GLOBALS ; ++g) {
+		snprintf(line, sizeof(line), "let g%zu: i32 = %zu;\n", g, g);
+		append_str(ret, line);
+	}
+	for (size_t f = 0 ; f < FUNCTIONS ; ++f) {
+		snprintf(line, sizeof(line), "let f%zu: (a: i32) -> i32 = {\n\tlet v0: i32 = a;\n", f);
+		append_str(ret, line);
+		for (size_t d = 1 ; d < DEPTH ; ++d) {
+			indent(ret, d);
+			snprintf(line, sizeof(line), "if (v%zu > g%zu) {\n", d - 1, d % GLOBALS);
+			append_str(ret, line);
+			indent(ret, d + 1);
+			snprintf(line, sizeof(line), "let v%zu: i32 = v%zu + a * g%zu;\n", d, d - 1, (d * 7) % GLOBALS);
+			append_str(ret, line);
+		}
+		for (size_t d = DEPTH - 1 ; d > 0 ; --d) {
+			indent(ret, d);
+			append_str(ret, "}\n");
+		}
+		append_str(ret, "\treturn v0;\n};\n");
+	}
+	return ret;
+}
+
+int main(void)
+{
+	strvec *text = gen_source();
+	source src = {text->text, text->size - 1, 0};
+	compile_ctx *c = compile_ctx_init();
+	token_list *toks;
+	ast_decl *program;
+	double best_check = 1e9;
+	double best_codegen = 1e9;
+
+	LLVMInitializeNativeTarget();
+	toks = scan(c, &src);
+	for (int r = 0 ; r < RUNS ; ++r) {
+		program = parse_program(c, toks);
+		double start = now();
+		typecheck_program(c, program);
+		double mid = now();
+		if (c->had_error) {
+			fprintf(stderr, "bench_scope: generated program failed to typecheck\n");
+			return 1;
+		}
+		LLVMContextRef ctxt = LLVMContextCreate();
+		LLVMModuleRef mod = module_codegen(c, ctxt, program, "bench_scope");
+		double end = now();
+		LLVMDisposeModule(mod);
+		LLVMContextDispose(ctxt);
+		if (mid - start < best_check)
+			best_check = mid - start;
+		if (end - mid < best_codegen)
+			best_codegen = end - mid;
+		// Typechecking rewrites the AST, so every run gets a fresh one.
+		compile_ctx_drop_ast(c);
+	}
+	printf("bench_scope: %d functions nested %d deep, best of %d: typecheck %.2f ms, codegen %.2f ms\n",
+			FUNCTIONS, DEPTH, RUNS, best_check * 1e3, best_codegen * 1e3);
+	tok_list_destroy(toks);
+	strvec_destroy(text);
+	compile_ctx_destroy(c);
+	return 0;
+}
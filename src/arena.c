@@ -0,0 +1,73 @@
+#include "arena.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Every allocation is rounded up to this so anything can be stored in the arena.
+#define ARENA_ALIGN 16
+
+// `used` starts out at however many bytes it takes to align the first allocation.
+// Since every allocation size is a multiple of ARENA_ALIGN, the rest follow suit.
+static struct arena_block *block_init(size_t size, struct arena_block *next)
+{
+	struct arena_block *ret = smalloc(sizeof(*ret) + size + ARENA_ALIGN);
+	ret->next = next;
+	ret->used = -(uintptr_t)ret->data & (ARENA_ALIGN - 1);
+	ret->size = size + ret->used;
+	return ret;
+}
+
+arena *arena_init(size_t block_size)
+{
+	arena *ret = smalloc(sizeof(*ret));
+	ret->block_size = block_size;
+	ret->cleanups = NULL;
+	ret->head = block_init(block_size, NULL);
+	return ret;
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+	struct arena_block *b = a->head;
+	void *ret;
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (b->size - b->used < size) {
+		// Oversized allocations get a block of their own, placed behind the
+		// current one so the rest of the current block doesn't go to waste.
+		if (size > a->block_size / 4) {
+			b->next = block_init(size, b->next);
+			ret = b->next->data + b->next->used;
+			b->next->used += size;
+			return ret;
+		}
+		b = a->head = block_init(a->block_size, a->head);
+	}
+	ret = b->data + b->used;
+	b->used += size;
+	return ret;
+}
+
+void arena_defer(arena *a, void (*fn)(void *), void *ptr)
+{
+	struct arena_cleanup *c = arena_alloc(a, sizeof(*c));
+	c->fn = fn;
+	c->ptr = ptr;
+	c->next = a->cleanups;
+	a->cleanups = c;
+}
+
+void arena_destroy(arena *a)
+{
+	struct arena_block *tmp;
+	if (a == NULL)
+		return;
+	for (struct arena_cleanup *c = a->cleanups ; c != NULL ; c = c->next)
+		c->fn(c->ptr);
+	while (a->head) {
+		tmp = a->head->next;
+		free(a->head);
+		a->head = tmp;
+	}
+	free(a);
+}
@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// A bump allocator: allocations are carved out of big blocks and are only ever
+// freed all at once by arena_destroy.
+// Things that have to live on the heap (growable buffers, ...) can still be tied to
+// an arena with arena_defer: arena_destroy calls fn(ptr) for each of them.
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct arena_cleanup {
+	struct arena_cleanup *next;
+	void (*fn)(void *);
+	void *ptr;
+};
+
+typedef struct arena {
+	struct arena_block *head;
+	struct arena_cleanup *cleanups;
+	size_t block_size;
+} arena;
+
+arena *arena_init(size_t block_size);
+void *arena_alloc(arena *a, size_t size);
+void arena_defer(arena *a, void (*fn)(void *), void *ptr);
+void arena_destroy(arena *a);
+
+#endif
@@ -1,214 +1,119 @@
+#include "arena.h"
 #include "ast.h"
+#include "compiler.h"
 #include "util.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+void *ast_alloc(size_t size)
+{
+	return arena_alloc(cur_ctx->ast_arena, size);
+}
+
+static void vect_cleanup(void *v)
+{
+	vect_destroy(v);
+}
+
+static void strvec_cleanup(void *s)
+{
+	strvec_destroy(s);
+}
+
+vect *ast_vect_init(size_t capacity)
+{
+	vect *ret = vect_init(capacity);
+	arena_defer(cur_ctx->ast_arena, vect_cleanup, ret);
+	return ret;
+}
+
 ast_decl *decl_init(ast_typed_symbol *typesym, ast_expr *expr, ast_stmt *stmt, ast_decl *next, size_t line)
 {
-	ast_decl *ret = smalloc(sizeof(*ret));
+	ast_decl *ret = ast_alloc(sizeof(*ret));
 	ret->typesym = typesym;
 	ret->body = stmt;
 	ret->expr = expr;
 	ret->next = next;
 	ret->initializer = NULL;
 	ret->line = line;
+	ret->file = NULL;
+	ret->num_locals = 0;
 	return ret;
 }
 
-ast_type *type_init(type_t kind, strvec *name)
-{
-	ast_type *ret = smalloc(sizeof(*ret));
-	ret->subtype = NULL;
-	ret->owns_subtype = 1;
-	ret->arglist = NULL;
-	ret->kind = kind;
-	ret->name = name;
-	ret->modif = VM_DEFAULT;
-	return ret;
-}
-
-ast_expr *expr_init(expr_t kind, ast_expr *left, ast_expr *right, token_t op, strvec *name,
+ast_expr *expr_init(expr_t kind, ast_expr *left, ast_expr *right, token_t op, istr *name,
 			int64_t num, strvec *str_lit)
 {
-	ast_expr *ret = smalloc(sizeof(*ret));
+	ast_expr *ret = ast_alloc(sizeof(*ret));
 	ret->kind = kind;
-	ret->left = left;
-	ret->right = right;
 	ret->op = op;
-	ret->name = name;
-	ret->num = num;
-	ret->sub_exprs = NULL;
 	ret->is_lvalue = 0;
-	ret->string_literal = str_lit;
 	ret->type = NULL;
-	ret->owns_type = false;
+	switch (kind) {
+	case E_INT_LIT:
+		ret->num = num;
+		break;
+	case E_STR_LIT:
+	case E_CHAR_LIT:
+		ret->string_literal = str_lit;
+		if (str_lit != NULL)
+			arena_defer(cur_ctx->ast_arena, strvec_cleanup, str_lit);
+		break;
+	case E_IDENTIFIER:
+	case E_FNCALL:
+	case E_VECTOR_OP:
+		ret->name = name;
+		ret->sub_exprs = NULL;
+		ret->is_global = 0;
+		ret->slot = 0;
+		break;
+	default:
+		ret->left = left;
+		ret->right = right;
+	}
 	return ret;
 }
 
-ast_typed_symbol *ast_typed_symbol_init(ast_type *type, strvec *symbol)
+ast_typed_symbol *ast_typed_symbol_init(ast_type *type, istr *symbol)
 {
-	ast_typed_symbol *ret = smalloc(sizeof(*ret));
+	ast_typed_symbol *ret = ast_alloc(sizeof(*ret));
 	ret->type = type;
 	ret->symbol = symbol;
+	ret->slot = 0;
+	ret->is_global = 0;
+	ret->escapes = 0;
 	return ret;
 }
 
 ast_stmt *stmt_init(stmt_t kind, ast_decl *decl, ast_expr *expr, ast_stmt *body,
 			ast_stmt *else_body, size_t line)
 {
-	ast_stmt *ret = smalloc(sizeof(*ret));
+	ast_stmt *ret = ast_alloc(sizeof(*ret));
 	ret->kind = kind;
-	ret->decl = decl;
-	ret->expr = expr;
-	ret->body = body;
-	ret->else_body = else_body;
 	ret->next = NULL;
-	ret->asm_obj = NULL;
 	ret->line = line;
 	ret->return_worthy = RETW_UNCHECKED;
-
-	return ret;
-}
-
-static void asm_struct_destroy(asm_struct *a)
-{
-	if (a == NULL)
-		return;
-	expr_destroy(a->code);
-	expr_destroy(a->constraints);
-	for (size_t i = 0 ; a->in_operands != NULL && i < a->in_operands->size ; ++i) {
-		expr_destroy(vect_get(a->in_operands, i));
-	}
-	for (size_t i = 0 ; a->out_operands != NULL && i < a->out_operands->size ; ++i) {
-		expr_destroy(vect_get(a->out_operands, i));
-	}
-	vect_destroy(a->in_operands);
-	vect_destroy(a->out_operands);
-	free(a);
-}
-
-void stmt_destroy(ast_stmt *stmt)
-{
-	ast_stmt *next;
-	if (stmt == NULL)
-		return;
-	next = stmt->next;
-	asm_struct_destroy(stmt->asm_obj);
-	decl_destroy(stmt->decl);
-	expr_destroy(stmt->expr);
-	stmt_destroy(stmt->body);
-	stmt_destroy(stmt->else_body);
-	free(stmt);
-	stmt_destroy(next);
-}
-
-void type_destroy(ast_type *type)
-{
-	if (type == NULL)
-		return;
-	arglist_destroy(type->arglist);
-	if (type->owns_subtype)
-		type_destroy(type->subtype);
-	strvec_destroy(type->name);
-	free(type);
-}
-
-void destroy_expr_vect(vect *expr_vect)
-{
-	if (expr_vect == NULL)
-		return;
-	for (size_t i = 0 ; i < expr_vect->size ; ++i)
-		expr_destroy((ast_expr *)expr_vect->elements[i]);
-	vect_destroy(expr_vect);
-}
-
-void expr_destroy(ast_expr *expr)
-{
-	if (expr == NULL)
-		return;
-	expr_destroy(expr->right);
-	expr_destroy(expr->left);
-	strvec_destroy(expr->name);
-	strvec_destroy(expr->string_literal);
-	destroy_expr_vect(expr->sub_exprs);
-
-	// See the note in the ast.h ast_expr struct definition for details.
-	if (expr->owns_type)
-		type_destroy(expr->type);
-
-	free(expr);
-}
-
-
-void decl_destroy(ast_decl *decl)
-{
-	if (decl == NULL)
-		return;
-	if (decl->initializer != NULL) {
-		for (size_t i = 0 ; i < decl->initializer->size ; ++i)
-			expr_destroy(decl->initializer->elements[i]);
-		free(decl->initializer->elements);
-		free(decl->initializer);
+	switch (kind) {
+	case S_DECL:
+		ret->decl = decl;
+		break;
+	case S_ASM:
+		ret->asm_obj = NULL;
+		break;
+	case S_BREAK:
+	case S_CONTINUE:
+		ret->extra = NULL;
+		break;
+	default:
+		ret->expr = expr;
+		ret->body = body;
+		ret->else_body = else_body;
 	}
-	ast_typed_symbol_destroy(decl->typesym);
-	expr_destroy(decl->expr);
-	stmt_destroy(decl->body);
-	free(decl);
-}
-
-void ast_typed_symbol_destroy(ast_typed_symbol *typesym)
-{
-	if (typesym == NULL)
-		return;
-	type_destroy(typesym->type);
-	strvec_destroy(typesym->symbol);
-	free(typesym);
-}
-
-void ast_free(ast_decl *program)
-{
-	if (program == NULL)
-		return;
-	ast_decl *next = program->next;
-	decl_destroy(program);
-	ast_free(next);
-}
 
-ast_type *type_copy(ast_type *t)
-{
-	ast_type *ret;
-	if (t == NULL)
-		return NULL;
-	ret = type_init(t->kind, strvec_copy(t->name));
-	ret->subtype = type_copy(t->subtype);
-	ret->arglist = arglist_copy(t->arglist);
-	ret->modif = t->modif;
-	return ret;
-}
-
-vect *arglist_copy(vect *arglist)
-{
-	vect *ret = NULL;
-	if (arglist == NULL)
-		return ret;
-	ret = vect_init(arglist->size);
-	for (size_t i = 0 ; i < arglist->size ; ++i) {
-		ast_typed_symbol *cur = arglist_get(arglist, i);
-		vect_append(ret, (void *)ast_typed_symbol_init(type_copy(cur->type), strvec_copy(cur->symbol)));
-	}
 	return ret;
 }
 
-void arglist_destroy(vect *arglist)
-{
-	if (arglist == NULL)
-		return;
-	for (size_t i = 0 ; i < arglist->size ; ++i)
-		ast_typed_symbol_destroy(arglist_get(arglist, i));
-	vect_destroy(arglist);
-}
-
 type_t smallest_fit(int64_t num)
 {
 	int64_t max_32 = 2147483647;
@@ -242,6 +147,17 @@ bool is_integer(ast_type *t)
 	}
 }
 
+ast_expr *vector_lane(ast_expr *e)
+{
+	while (e != NULL && e->kind == E_PAREN)
+		e = e->left;
+	if (e == NULL || e->kind != E_POST_UNARY || e->op != T_LBRACKET)
+		return NULL;
+	if (e->left->type == NULL || e->left->type->kind != Y_VECTOR)
+		return NULL;
+	return e;
+}
+
 char *decl_name(ast_decl *d)
 {
 	if (d == NULL)
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 
+#include "intern.h"
 #include "token.h"
 #include "util.h"
 
@@ -15,6 +16,10 @@ typedef struct ast_decl {
 	struct ast_decl *next;
 	struct vect *initializer;
 	size_t line;
+	// Top-level declarations: the file they are in, see compile_ctx.
+	const char *file;
+	// Functions: how many local slots (arguments and declarations) the body uses.
+	size_t num_locals;
 } ast_decl;
 
 // Quick note on Y_STRUCT type and declarations:
@@ -47,6 +52,7 @@ typedef enum {
 	Y_CONSTPTR = 0x0003, // the values at the memory address being pointed to cannot be changed using this ptr
 	Y_FUNCTION = 0x0004,
 	Y_STRUCT = 0x0005,
+	Y_VECTOR = 0x0006, // SIMD vector of `lanes` subtypes, which are integers
 	// kinda dumb but useful: integer types encode bit witdth in the 4 binary digits at 0x0F00,
 	// and the 0xF000 bits encode signedness: 1 is unsigned, 2 is signed.
 	// TYPE_SIGNEDNESS_MASK and TYPE_WIDTH_MASK help keep track of this!
@@ -68,18 +74,36 @@ typedef enum {
 	VM_PROTO_DEFINED, // is a prototype and has a definition in the current module
 } value_modifier_t;
 
+// Types are interned, see types.h.
 typedef struct ast_type {
 	struct ast_type *subtype;
-	bool owns_subtype;
 	vect *arglist;
 	type_t kind;
-	strvec *name;
+	istr *name;
 	value_modifier_t modif;
+	uint64_t hash;
+	struct ast_type *unqual;
+	// Struct definitions only: field name -> struct_field.
+	struct ht *fields;
+	// Vectors only: the number of elements.
+	uint32_t lanes;
 } ast_type;
 
+typedef struct struct_field {
+	ast_type *type;
+	size_t pos;
+} struct_field;
+
+// slot and is_global are set by the typechecker when the symbol is bound. Globals are
+// numbered across the module, everything else within its function, and codegen keeps
+// each symbol's value in an array indexed by its slot. escapes is set when the symbol
+// is used for anything other than being indexed.
 typedef struct ast_typed_symbol {
 	struct ast_type *type;
-	strvec *symbol;
+	istr *symbol;
+	uint32_t slot;
+	uint8_t is_global;
+	uint8_t escapes;
 } ast_typed_symbol;
 
 typedef enum {
@@ -106,41 +130,54 @@ typedef enum {
 	E_CAST,
 	E_SHIFT,
 	E_NULL,
+	E_VECTOR_OP,
 } expr_t;
 
 type_t smallest_fit(int64_t num);
 
+// Only the members of the union that belong to an expr's kind are valid! Reading e.g.
+// `num` off of an E_ADDSUB reads garbage.
 typedef struct ast_expr {
 	expr_t kind;
-	struct ast_expr *left;
-	struct ast_expr *right;
 	token_t op;
-	strvec *name;
-	int64_t num;
-	strvec *string_literal;
-	vect *sub_exprs;
 	uint8_t is_lvalue;
+	// E_IDENTIFIER and E_FNCALL: the binding the name resolved to during typechecking.
+	uint8_t is_global;
+	uint32_t slot;
 
-	// Expressions may either own their types or not own their types. Exprs must free types
-	// if and only if they own their types. Exprs only own types if the type of the expr
-	// was specifically made for that expr. An expr's type ptr can point to a type in the
-	// symbol table, another expr's type, or to a novel type created just for the expr.
-	// We don't care about the specifics, we just have to know if it is the current expr's
-	// responsibility to free that type.
-	//
-	// Sharing types can save tons of time and memory, it is just a little annoying to keep
-	// track of which exprs are in charge of freeing which types.
-	bool owns_type;
+	// An expr's type ptr can point to a type in the symbol table, another expr's type, or
+	// to a novel type created just for the expr. All of them live in the AST arena, so
+	// sharing is free and nobody has to keep track of who frees what.
 	ast_type *type;
+	union {
+		// Operators, E_PAREN and E_CAST. Unary operators only use left, except for
+		// E_POST_UNARY indexing and member access, where right is the index / member.
+		struct {
+			struct ast_expr *left;
+			struct ast_expr *right;
+		};
+		// E_INT_LIT
+		int64_t num;
+		// E_STR_LIT and E_CHAR_LIT. A string literal's text is also interned during
+		// typechecking as pooled, which is what codegen shares its global by.
+		struct {
+			strvec *string_literal;
+			istr *pooled;
+		};
+		// E_IDENTIFIER, E_FNCALL and E_VECTOR_OP. sub_exprs holds the arguments of a
+		// call, or of the vector builtin named by op (shuffle, loadu, storeu).
+		struct {
+			istr *name;
+			vect *sub_exprs;
+		};
+	};
 } ast_expr;
 
-#define IS_UNSIGNED(e) UNSIGNED(e->type->kind)
+// Vectors are as unsigned as their elements.
+#define IS_UNSIGNED(e) UNSIGNED(((e)->type->kind == Y_VECTOR ? (e)->type->subtype : (e)->type)->kind)
 
-void expr_add_sub_expr(ast_expr *e, ast_expr *sub);
-vect *sub_exprs_init(size_t size);
-void destroy_expr_vect(vect *expr_vect);
 
-typedef enum { S_ERROR, S_BLOCK, S_DECL, S_EXPR, S_IFELSE, S_RETURN, S_WHILE, S_BREAK, S_CONTINUE, S_ASM} stmt_t;
+typedef enum { S_ERROR, S_BLOCK, S_DECL, S_EXPR, S_IFELSE, S_RETURN, S_WHILE, S_FOR, S_BREAK, S_CONTINUE, S_ASM} stmt_t;
 
 typedef struct asm_struct {
 	ast_expr *code;
@@ -149,39 +186,62 @@ typedef struct asm_struct {
 	vect *in_operands;
 } asm_struct;
 
+// The parts of a `for` statement that a `while` doesn't have. Any of init, the condition
+// and step can be left out. The hints are 0 unless the loop asked for them, and end up
+// in the loop's llvm.loop metadata.
+typedef struct for_struct {
+	struct ast_stmt *init;
+	struct ast_expr *step;
+	uint32_t unroll;
+	uint32_t vectorize;
+	uint32_t interleave;
+} for_struct;
+
 typedef enum {RETW_UNCHECKED, RETW_FALSE, RETW_TRUE} retw_t;
 
+// Same deal as ast_expr: only the union members of the stmt's kind are valid.
 typedef struct ast_stmt {
 	stmt_t kind;
-	struct ast_decl *decl;
-	struct ast_expr *expr;
-	struct ast_stmt *body;
-	struct ast_stmt *else_body;
-	struct ast_stmt *next;
-	struct asm_struct *asm_obj;
-	void *extra; // THIS SUCKS: break/continues need to know where to go next, this is where I stuff the LLVMBasicBlockRef
-	size_t line;
 	retw_t return_worthy;
+	size_t line;
+	struct ast_stmt *next;
+	union {
+		// S_DECL
+		struct ast_decl *decl;
+		// S_ASM
+		struct asm_struct *asm_obj;
+		// S_BREAK, S_CONTINUE
+		void *extra; // THIS SUCKS: break/continues need to know where to go next, this is where I stuff the LLVMBasicBlockRef
+		// S_EXPR, S_RETURN (expr), S_BLOCK (body), S_IFELSE, S_WHILE and S_FOR
+		struct {
+			struct ast_expr *expr;
+			struct ast_stmt *body;
+			union {
+				struct ast_stmt *else_body;
+				// S_FOR
+				struct for_struct *for_obj;
+			};
+		};
+	};
 } ast_stmt;
 
+// Every AST node (and everything hanging off of one) is allocated from the current
+// compilation's arena, which is freed in one go by compile_ctx_destroy.
+void *ast_alloc(size_t size);
+// A vect that is freed along with the AST arena.
+vect *ast_vect_init(size_t capacity);
+
 ast_decl *decl_init(ast_typed_symbol *typesym, ast_expr *expr, ast_stmt *stmt, ast_decl *next, size_t line);
 char *decl_name(ast_decl *d);
-ast_type *type_init(type_t kind, strvec *name);
-ast_typed_symbol *ast_typed_symbol_init(ast_type *type, strvec *symbol);
-ast_expr *expr_init(expr_t kind, ast_expr *left, ast_expr *right, token_t op, strvec *name,
+ast_typed_symbol *ast_typed_symbol_init(ast_type *type, istr *symbol);
+ast_expr *expr_init(expr_t kind, ast_expr *left, ast_expr *right, token_t op, istr *name,
 			int64_t num, strvec *str_lit);
 ast_stmt *stmt_init(stmt_t kind, ast_decl *decl, ast_expr *expr, ast_stmt *body,
 			ast_stmt *else_body, size_t line);
-void ast_free(ast_decl *program);
-void type_destroy(ast_type *type);
-void expr_destroy(ast_expr *expr);
-void decl_destroy(ast_decl *decl);
-void stmt_destroy(ast_stmt *stmt);
-void ast_typed_symbol_destroy(ast_typed_symbol *typesym);
-ast_type *type_copy(ast_type *t);
-vect *arglist_copy(vect *arglist);
-
-void arglist_destroy(vect *arglist);
+
 ast_stmt *last(ast_stmt *block);
 bool is_integer(ast_type *t);
+// The vector lane access e is, looking through parens, or NULL if it isn't one.
+// Only valid once e has been typechecked.
+ast_expr *vector_lane(ast_expr *e);
 #endif
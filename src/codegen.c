@@ -2,17 +2,25 @@
 #include "codegen.h"
 #include "error.h"
 #include "ht.h"
-#include "symbol_table.h"
 #include "util.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/DebugInfo.h>
+#include <llvm-c/Linker.h>
 
 #define CTXT(mod) (LLVMGetModuleContext(mod))
 
-extern struct stack *sym_tab;
-LLVMTargetDataRef td = NULL;
+// What codegen knows about a defined struct, looked up by the struct's name.
+struct llvm_struct {
+	LLVMTypeRef type;
+	ast_type *def;
+};
 
 static LLVMTypeRef to_llvm_type(LLVMModuleRef mod, ast_type *tp)
 {
@@ -33,8 +41,10 @@ static LLVMTypeRef to_llvm_type(LLVMModuleRef mod, ast_type *tp)
 		return LLVMPointerType(LLVMInt8TypeInContext(ctxt), 0);
 	case Y_CHAR:
 		return LLVMInt8TypeInContext(ctxt);
+	case Y_VECTOR:
+		return LLVMVectorType(to_llvm_type(mod, tp->subtype), tp->lanes);
 	case Y_STRUCT:
-		return LLVMGetTypeByName(mod, tp->name->text);
+		return ((struct llvm_struct *)ht_get(cur_ctx->structs, tp->name))->type;
 	// LCOV_EXCL_START
 	default:
 		fprintf(stderr, "couldn't convert type\n");
@@ -43,53 +53,206 @@ static LLVMTypeRef to_llvm_type(LLVMModuleRef mod, ast_type *tp)
 	}
 }
 
-LLVMModuleRef module_codegen(LLVMContextRef ctxt, ast_decl *start, char *module_name)
+static LLVMCodeGenOptLevel codegen_level(opt_level_t level)
 {
-	LLVMModuleRef ret = LLVMModuleCreateWithNameInContext(module_name, ctxt);
-	char *triple = LLVMGetDefaultTargetTriple();
+	switch (level) {
+	case OPT_O0:
+		return LLVMCodeGenLevelNone;
+	case OPT_O1:
+		return LLVMCodeGenLevelLess;
+	case OPT_O3:
+		return LLVMCodeGenLevelAggressive;
+	default:
+		return LLVMCodeGenLevelDefault;
+	}
+}
+
+static char *copy_str(const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ret = smalloc(len);
+	memcpy(ret, str, len);
+	return ret;
+}
+
+// "native" as the CPU means the host's CPU with all of the host's features, like clang's
+// -march=native. Features given on top of that come after the host's, so they win.
+static void resolve_target(compile_ctx *c)
+{
+	int native = c->cpu != NULL && strcmp(c->cpu, "native") == 0;
+	char *host = NULL;
+	const char *features = c->features == NULL ? "" : c->features;
+
+	if (native) {
+		host = LLVMGetHostCPUName();
+		c->target_cpu = copy_str(host);
+		LLVMDisposeMessage(host);
+		host = LLVMGetHostCPUFeatures();
+	} else {
+		c->target_cpu = copy_str(c->cpu == NULL ? "generic" : c->cpu);
+	}
+	if (c->features != NULL && strcmp(c->features, "native") == 0) {
+		if (host == NULL)
+			host = LLVMGetHostCPUFeatures();
+		features = "";
+	}
+	if (host != NULL && *host != '\0' && *features != '\0') {
+		size_t len = strlen(host) + strlen(features) + 2;
+		c->target_features = smalloc(len);
+		snprintf(c->target_features, len, "%s,%s", host, features);
+	} else {
+		c->target_features = copy_str(host != NULL && *host != '\0' ? host : features);
+	}
+	LLVMDisposeMessage(host);
+}
+
+void target_init(compile_ctx *c)
+{
+	char *triple;
 	LLVMTargetRef tgt = NULL;
-	LLVMGetTargetFromTriple(triple, &tgt, NULL);
 
-	// TODO: make this customizable.
-	LLVMTargetMachineRef tm = LLVMCreateTargetMachine(tgt, triple, "generic", "", LLVMCodeGenLevelNone, LLVMRelocDefault, LLVMCodeModelDefault);
-	td = LLVMCreateTargetDataLayout(tm);
+	if (c->tm != NULL)
+		return;
+	resolve_target(c);
+	triple = LLVMGetDefaultTargetTriple();
+	LLVMGetTargetFromTriple(triple, &tgt, NULL);
+	c->tm = LLVMCreateTargetMachine(tgt, triple, c->target_cpu, c->target_features,
+			codegen_level(c->opt_level), LLVMRelocPIC, LLVMCodeModelDefault);
+	c->td = LLVMCreateTargetDataLayout(c->tm);
+	LLVMDisposeMessage(triple);
+}
 
+LLVMModuleRef module_codegen(compile_ctx *c, LLVMContextRef ctxt, ast_decl *start, char *module_name)
+{
+	LLVMModuleRef ret;
+	char *triple;
+	cur_ctx = c;
+	target_init(c);
+	ret = LLVMModuleCreateWithNameInContext(module_name, ctxt);
+	triple = LLVMGetTargetMachineTriple(c->tm);
+	LLVMSetTarget(ret, triple);
+	LLVMDisposeMessage(triple);
+	LLVMSetModuleDataLayout(ret, c->td);
 
+	c->structs = ht_init(16, free);
+	c->strings = ht_init(64, NULL);
+	c->globals = scalloc(c->num_globals, sizeof(*c->globals));
+	c->next_body = 0;
 	while (start) {
 		decl_codegen(&ret, start);
 		start = start->next;
 	}
-
-	LLVMDisposeMessage(triple);
-	LLVMDisposeTargetData(td);
-	LLVMDisposeTargetMachine(tm);
+	ht_destroy(c->structs);
+	c->structs = NULL;
+	ht_destroy(c->strings);
+	c->strings = NULL;
+	free(c->globals);
+	c->globals = NULL;
 
 	return ret;
 }
 
-// This function is a little intimidating: but it is quite simple.
-// First it allocates space for an array on the stack (with element type determined by decl subtype)
-// then it populates each array space with the corresponding element from the initializer
-// then it builds a cast of the array type to a pointer type so it can be treated like any other ptr.
-//	this casted pointer is what is used later.
-static void initializer_codegen(LLVMModuleRef mod, LLVMTypeRef typ, LLVMBuilderRef builder, ast_stmt *stmt)
+static const char *pipelines[] = {
+	[OPT_O0] = "function(mem2reg)",
+	[OPT_O1] = "default<O1>",
+	[OPT_O2] = "default<O2>",
+	[OPT_O3] = "default<O3>",
+	[OPT_OS] = "default<Os>",
+};
+
+// Runs the new pass manager's standard pipeline for c->opt_level over mod. -O0 only
+// promotes locals to registers. Vectorization is turned on at the same levels clang
+// turns it on.
+void module_optimize(compile_ctx *c, LLVMModuleRef mod)
 {
-	LLVMValueRef idx;
+	LLVMPassBuilderOptionsRef opts;
+	LLVMErrorRef e;
+	int vectorize = c->opt_level == OPT_O2 || c->opt_level == OPT_O3 || c->opt_level == OPT_OS;
+
+	target_init(c);
+	opts = LLVMCreatePassBuilderOptions();
+	LLVMPassBuilderOptionsSetLoopVectorization(opts, vectorize);
+	LLVMPassBuilderOptionsSetSLPVectorization(opts, vectorize);
+	e = LLVMRunPasses(mod, pipelines[c->opt_level], c->tm, opts);
+	if (e != NULL) {
+		char *msg = LLVMGetErrorMessage(e);
+		fprintf(stderr, "Optimization pipeline failed: %s\n", msg);
+		LLVMDisposeErrorMessage(msg);
+		c->had_error = 1;
+	}
+	LLVMDisposePassBuilderOptions(opts);
+}
 
-	LLVMTypeRef llvmified_inner = to_llvm_type(mod, stmt->decl->typesym->type->subtype);
+// Every local lives in an alloca at the top of the function's entry block, in declaration
+// order, wherever its `let` is. That keeps them static (a `let` in a loop body doesn't
+// grow the stack on every iteration) and lets mem2reg promote them to registers.
+// The builder is always at the end of its block, so it can go back there afterwards.
+static LLVMValueRef entry_alloca(LLVMBuilderRef builder, LLVMTypeRef type, const char *name)
+{
+	LLVMBasicBlockRef cur = LLVMGetInsertBlock(builder);
+	LLVMBasicBlockRef entry = LLVMGetEntryBasicBlock(LLVMGetBasicBlockParent(cur));
+	LLVMValueRef next;
+
+	if (cur_ctx->last_alloca == NULL)
+		next = LLVMGetFirstInstruction(entry);
+	else
+		next = LLVMGetNextInstruction(cur_ctx->last_alloca);
+	if (next == NULL)
+		LLVMPositionBuilderAtEnd(builder, entry);
+	else
+		LLVMPositionBuilderBefore(builder, next);
+	cur_ctx->last_alloca = LLVMBuildAlloca(builder, type, name);
+	LLVMPositionBuilderAtEnd(builder, cur);
+	return cur_ctx->last_alloca;
+}
 
-	LLVMTypeRef array_type = LLVMArrayType(llvmified_inner, stmt->decl->initializer->size);
-	LLVMValueRef init = LLVMBuildAlloca(builder, array_type, "");
-	for (size_t i = 0 ; i < stmt->decl->initializer->size ; ++i) { // clang uses memcpy for this! would be much better!
-		idx = LLVMConstInt(LLVMInt32TypeInContext(CTXT(mod)), i, 0);
-		LLVMValueRef gep = LLVMBuildGEP2(builder, typ, init, &idx, 1, "");
-		LLVMValueRef value = expr_codegen(mod, builder, stmt->decl->initializer->elements[i], 0);
-		LLVMBuildStore(builder, value, gep);
+// Array initializers are backed by an array the size of the initializer, which the
+// declared pointer is set to point at.
+// When every element is a constant the array's contents go into a private constant
+// global, like clang does. A const pointer that is only ever indexed can point straight
+// at the global (nothing can write through it or hold on to it), anything else gets a
+// copy on the stack made with a single memcpy. Otherwise the elements are stored into
+// the stack array one at a time.
+static void initializer_codegen(LLVMModuleRef mod, LLVMTypeRef typ, LLVMBuilderRef builder, ast_stmt *stmt)
+{
+	ast_typed_symbol *ts = stmt->decl->typesym;
+	vect *elems = stmt->decl->initializer;
+	LLVMTypeRef array_type = LLVMArrayType(typ, elems->size);
+	LLVMTypeRef ptr_type = LLVMPointerType(typ, 0);
+	LLVMValueRef *values = smalloc(elems->size * sizeof(*values));
+	LLVMValueRef init = NULL;
+	LLVMValueRef data;
+	int all_const = 1;
+
+	for (size_t i = 0 ; i < elems->size ; ++i) {
+		values[i] = expr_codegen(mod, builder, elems->elements[i], 0);
+		all_const = all_const && LLVMIsConstant(values[i]);
 	}
-	LLVMValueRef alloca2 = LLVMBuildAlloca(builder, LLVMPointerType(llvmified_inner, 0), stmt->decl->typesym->symbol->text);
-	idx = LLVMConstInt(LLVMInt32Type(), 0, 0);
-	LLVMBuildStore(builder, LLVMBuildPointerCast(builder, init, LLVMPointerType(llvmified_inner, 0), ""), alloca2);
-	scope_bind(alloca2, stmt->decl->typesym->symbol);
+	if (all_const) {
+		data = LLVMAddGlobal(mod, array_type, "");
+		LLVMSetInitializer(data, LLVMConstArray(typ, values, elems->size));
+		LLVMSetGlobalConstant(data, 1);
+		LLVMSetLinkage(data, LLVMPrivateLinkage);
+		LLVMSetUnnamedAddress(data, LLVMGlobalUnnamedAddr);
+		LLVMSetAlignment(data, LLVMABIAlignmentOfType(cur_ctx->td, array_type));
+		if (ts->type->kind == Y_CONSTPTR && !ts->escapes) {
+			init = data;
+		} else {
+			init = entry_alloca(builder, array_type, "");
+			LLVMBuildMemCpy(builder, init, LLVMGetAlignment(init), data, LLVMGetAlignment(data),
+					LLVMConstInt(LLVMInt64TypeInContext(CTXT(mod)), LLVMABISizeOfType(cur_ctx->td, array_type), 0));
+		}
+	} else {
+		init = entry_alloca(builder, array_type, "");
+		for (size_t i = 0 ; i < elems->size ; ++i) {
+			LLVMValueRef idx = LLVMConstInt(LLVMInt32TypeInContext(CTXT(mod)), i, 0);
+			LLVMBuildStore(builder, values[i], LLVMBuildGEP2(builder, typ, init, &idx, 1, ""));
+		}
+	}
+	free(values);
+	LLVMValueRef alloca2 = entry_alloca(builder, ptr_type, ts->symbol->text);
+	LLVMBuildStore(builder, LLVMBuildPointerCast(builder, init, ptr_type, ""), alloca2);
+	cur_ctx->locals[ts->slot] = alloca2;
 }
 
 static int followed_by_branch(ast_stmt *stmt) {
@@ -98,7 +261,7 @@ static int followed_by_branch(ast_stmt *stmt) {
 	stmt = stmt->next;
 	while (stmt != NULL) {
 		if (stmt->kind == S_IFELSE
-				|| stmt->kind == S_WHILE || stmt->kind == S_RETURN
+				|| stmt->kind == S_WHILE || stmt->kind == S_FOR || stmt->kind == S_RETURN
 				|| stmt->kind == S_BREAK || stmt->kind == S_CONTINUE)
 			return 1;
 		stmt = stmt->next;
@@ -199,6 +362,91 @@ static void while_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_stmt *s
 	}
 }
 
+static LLVMMetadataRef loop_property(LLVMContextRef ctxt, const char *name, LLVMValueRef value)
+{
+	LLVMMetadataRef ops[2] = {LLVMMDStringInContext2(ctxt, name, strlen(name)), NULL};
+	if (value != NULL)
+		ops[1] = LLVMValueAsMetadata(value);
+	return LLVMMDNodeInContext2(ctxt, ops, value != NULL ? 2 : 1);
+}
+
+// Attaches a for loop's hints to its latch as !llvm.loop. The loop ID has to be a
+// distinct node that refers to itself, so it is made with a placeholder first operand,
+// which is then replaced with the node itself.
+static void loop_hints_codegen(LLVMContextRef ctxt, for_struct *f, LLVMValueRef latch)
+{
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(ctxt);
+	LLVMMetadataRef ops[5];
+	unsigned n = 1;
+
+	if (f->unroll == 0 && f->vectorize == 0 && f->interleave == 0)
+		return;
+	ops[0] = LLVMTemporaryMDNode(ctxt, NULL, 0);
+	if (f->unroll == 1)
+		ops[n++] = loop_property(ctxt, "llvm.loop.unroll.disable", NULL);
+	else if (f->unroll > 1)
+		ops[n++] = loop_property(ctxt, "llvm.loop.unroll.count", LLVMConstInt(i32, f->unroll, 0));
+	if (f->vectorize > 1)
+		ops[n++] = loop_property(ctxt, "llvm.loop.vectorize.enable",
+				LLVMConstInt(LLVMInt1TypeInContext(ctxt), 1, 0));
+	if (f->vectorize != 0)
+		ops[n++] = loop_property(ctxt, "llvm.loop.vectorize.width", LLVMConstInt(i32, f->vectorize, 0));
+	if (f->interleave != 0)
+		ops[n++] = loop_property(ctxt, "llvm.loop.interleave.count", LLVMConstInt(i32, f->interleave, 0));
+
+	LLVMMetadataRef id = LLVMMDNodeInContext2(ctxt, ops, n);
+	LLVMMetadataReplaceAllUsesWith(ops[0], id);
+	LLVMSetMetadata(latch, LLVMGetMDKindIDInContext(ctxt, "llvm.loop", 9), LLVMMetadataAsValue(ctxt, id));
+}
+
+// Like a while loop, with continue going to the step block, whose branch back to the
+// condition is the latch that gets the loop hints.
+static void for_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_stmt *stmt, LLVMBasicBlockRef p_con) {
+	LLVMValueRef cur_function;
+	LLVMContextRef ctxt = CTXT(mod);
+	for_struct *f = stmt->for_obj;
+	cur_function = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+
+	LLVMBasicBlockRef cod = LLVMAppendBasicBlockInContext(ctxt, cur_function, "cond");
+	LLVMBasicBlockRef fo = LLVMAppendBasicBlockInContext(ctxt, cur_function, "for");
+	LLVMBasicBlockRef step = LLVMAppendBasicBlockInContext(ctxt, cur_function, "step");
+	LLVMBasicBlockRef con = p_con;
+	if (stmt->next != NULL)
+		con = LLVMAppendBasicBlockInContext(ctxt, cur_function, "for_continue");
+
+	distribute_breaks_and_continues(stmt->body->body, con, step);
+
+	stmt_codegen(mod, builder, f->init, p_con);
+	LLVMBuildBr(builder, cod);
+	// for (init; condition; step)
+	LLVMPositionBuilderAtEnd(builder, cod);
+	LLVMValueRef v1;
+	if (stmt->expr != NULL)
+		LLVMBuildCondBr(builder, expr_codegen(mod, builder, stmt->expr, 0), fo, con);
+	else
+		LLVMBuildBr(builder, fo);
+
+	// {
+	//	// for code
+	// }
+	LLVMPositionBuilderAtEnd(builder, fo);
+	stmt_codegen(mod, builder, stmt->body, step);
+	v1 = LLVMGetLastInstruction(fo);
+	if (v1 == NULL || !LLVMIsATerminatorInst(v1))
+		LLVMBuildBr(builder, step);
+
+	LLVMPositionBuilderAtEnd(builder, step);
+	if (f->step != NULL)
+		expr_codegen(mod, builder, f->step, 0);
+	loop_hints_codegen(ctxt, f, LLVMBuildBr(builder, cod));
+
+	LLVMPositionBuilderAtEnd(builder, con);
+	if (p_con != con && !followed_by_branch(stmt)) {
+		v1 = LLVMBuildBr(builder, p_con);
+		LLVMPositionBuilderBefore(builder, v1);
+	}
+}
+
 static void asm_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_stmt *stmt)
 {
 	asm_struct *a = stmt->asm_obj;
@@ -270,13 +518,11 @@ void stmt_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_stmt *stmt, LLV
 		asm_codegen(mod, builder, stmt);
 		break;
 	case S_BLOCK:
-		scope_enter();
 		cur = stmt->body;
 		while (cur) {
 			stmt_codegen(mod, builder, cur, p_con);
 			cur = cur->next;
 		}
-		scope_exit();
 		break;
 	case S_EXPR:
 		expr_codegen(mod, builder, stmt->expr, 0);
@@ -294,8 +540,8 @@ void stmt_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_stmt *stmt, LLV
 		if (stmt->decl->initializer != NULL) {
 			initializer_codegen(mod, to_llvm_type(mod, stmt->decl->typesym->type->subtype), builder, stmt);
 		} else {
-			v1 = LLVMBuildAlloca(builder, to_llvm_type(mod, stmt->decl->typesym->type), stmt->decl->typesym->symbol->text);
-			scope_bind(v1, stmt->decl->typesym->symbol);
+			v1 = entry_alloca(builder, to_llvm_type(mod, stmt->decl->typesym->type), stmt->decl->typesym->symbol->text);
+			cur_ctx->locals[stmt->decl->typesym->slot] = v1;
 			if (stmt->decl->expr != NULL)
 				LLVMBuildStore(builder, expr_codegen(mod, builder, stmt->decl->expr, 0), v1);
 		}
@@ -303,6 +549,9 @@ void stmt_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_stmt *stmt, LLV
 	case S_WHILE:
 		while_codegen(mod, builder, stmt, p_con);
 		break;
+	case S_FOR:
+		for_codegen(mod, builder, stmt, p_con);
+		break;
 	case S_CONTINUE:
 	case S_BREAK:
 		LLVMBuildBr(builder, stmt->extra);
@@ -327,38 +576,48 @@ static void get_fncall_args(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr
 	}
 }
 
-static LLVMValueRef assign_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr, LLVMValueRef loc)
+// The value an assignment stores: its right side, or for a compound assignment the
+// binary op of its left and right.
+static LLVMValueRef assign_value_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr)
 {
-	LLVMValueRef ret;
-	LLVMValueRef tempval;
-	ast_expr *temp;
+	// The compound assignment's left and right, combined with the matching binary op.
+	// Lives on the stack: codegen never allocates AST nodes.
+	ast_expr temp = *expr;
 	if (expr->op == T_ASSIGN)
-		return LLVMBuildStore(builder, expr_codegen(mod, builder, expr->right, 0), loc);
+		return expr_codegen(mod, builder, expr->right, 0);
 
 	switch (expr->op) {
 	case T_MUL_ASSIGN:
-		temp = expr_init(E_MULDIV, expr->left, expr->right, T_STAR, NULL, 0, NULL);
+		temp.kind = E_MULDIV;
+		temp.op = T_STAR;
 		break;
 	case T_DIV_ASSIGN:
-		temp = expr_init(E_MULDIV, expr->left, expr->right, T_FSLASH, NULL, 0, NULL);
+		temp.kind = E_MULDIV;
+		temp.op = T_FSLASH;
 		break;
 	case T_MOD_ASSIGN:
-		temp = expr_init(E_MULDIV, expr->left, expr->right, T_PERCENT, NULL, 0, NULL);
+		temp.kind = E_MULDIV;
+		temp.op = T_PERCENT;
 		break;
 	case T_ADD_ASSIGN:
-		temp = expr_init(E_ADDSUB, expr->left, expr->right, T_PLUS, NULL, 0, NULL);
+		temp.kind = E_ADDSUB;
+		temp.op = T_PLUS;
 		break;
 	case T_SUB_ASSIGN:
-		temp = expr_init(E_ADDSUB, expr->left, expr->right, T_MINUS, NULL, 0, NULL);
+		temp.kind = E_ADDSUB;
+		temp.op = T_MINUS;
 		break;
 	case T_BW_AND_ASSIGN:
-		temp = expr_init(E_BW_AND, expr->left, expr->right, T_AMPERSAND, NULL, 0, NULL);
+		temp.kind = E_BW_AND;
+		temp.op = T_AMPERSAND;
 		break;
 	case T_BW_OR_ASSIGN:
-		temp = expr_init(E_BW_OR, expr->left, expr->right, T_BW_OR, NULL, 0, NULL);
+		temp.kind = E_BW_OR;
+		temp.op = T_BW_OR;
 		break;
 	case T_XOR_ASSIGN:
-		temp = expr_init(E_BW_XOR, expr->left, expr->right, T_XOR, NULL, 0, NULL);
+		temp.kind = E_BW_XOR;
+		temp.op = T_XOR;
 		break;
 	// LCOV_EXCL_START
 	default:
@@ -366,22 +625,46 @@ static LLVMValueRef assign_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, as
 		abort();
 	// LCOV_EXCL_STOP
 	}
-	tempval = expr_codegen(mod, builder, temp, 0);
-	ret = LLVMBuildStore(builder, tempval, loc);
-	free(temp); // do NOT expr_destroy!!!
-	return ret;
+	return expr_codegen(mod, builder, &temp, 0);
+}
+
+static LLVMValueRef assign_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr, LLVMValueRef loc)
+{
+	return LLVMBuildStore(builder, assign_value_codegen(mod, builder, expr), loc);
+}
+
+// A vector lane has no address to store to: the value is inserted into the vector,
+// which is stored back whole. A lane index past the end then gives poison rather than
+// a store outside the vector.
+static LLVMValueRef lane_assign_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr, ast_expr *lane)
+{
+	LLVMValueRef loc = expr_codegen(mod, builder, lane->left, 1);
+	LLVMValueRef idx = expr_codegen(mod, builder, lane->right, 0);
+	LLVMValueRef val = assign_value_codegen(mod, builder, expr);
+	// Loaded after the value, which may itself have written to the vector.
+	LLVMValueRef vec = LLVMBuildLoad2(builder, to_llvm_type(mod, lane->left->type), loc, "");
+	vec = LLVMBuildInsertElement(builder, vec, val, idx, "");
+	return LLVMBuildStore(builder, vec, loc);
 }
 
 // this function is courtesy of
 // https://stackoverflow.com/questions/65042902/create-and-reference-a-string-literal-via-llvm-c-interface
-LLVMValueRef define_const_string_literal(LLVMModuleRef mod, LLVMBuilderRef builder, const char *source_string, size_t size) {
-	LLVMTypeRef str_type = LLVMArrayType(LLVMInt8TypeInContext(CTXT(mod)), size);
-	LLVMValueRef str = LLVMAddGlobal(mod, str_type, "");
-	LLVMSetInitializer(str, LLVMConstStringInContext(CTXT(mod), source_string, size, 1));
-	LLVMSetGlobalConstant(str, 1);
-	LLVMSetLinkage(str, LLVMPrivateLinkage);
-	LLVMSetUnnamedAddress(str, LLVMGlobalUnnamedAddr);
-	LLVMSetAlignment(str, 1);
+// Every distinct literal gets one global per module, which all of its uses share. Under
+// -j that's per part, until module_link_parts merges them; objects emitted a part at a
+// time keep a copy per part.
+LLVMValueRef define_const_string_literal(LLVMModuleRef mod, LLVMBuilderRef builder, istr *lit) {
+	LLVMTypeRef str_type = LLVMArrayType(LLVMInt8TypeInContext(CTXT(mod)), lit->len);
+	LLVMValueRef str = ht_get(cur_ctx->strings, lit);
+
+	if (str == NULL) {
+		str = LLVMAddGlobal(mod, str_type, "");
+		LLVMSetInitializer(str, LLVMConstStringInContext(CTXT(mod), lit->text, lit->len, 1));
+		LLVMSetGlobalConstant(str, 1);
+		LLVMSetLinkage(str, LLVMPrivateLinkage);
+		LLVMSetUnnamedAddress(str, LLVMGlobalUnnamedAddr);
+		LLVMSetAlignment(str, 1);
+		ht_insert(cur_ctx->strings, lit, str);
+	}
 
 	LLVMValueRef zero_index = LLVMConstInt(LLVMInt64TypeInContext(CTXT(mod)), 0, 1);
 	LLVMValueRef indices[2] = {zero_index, zero_index};
@@ -389,25 +672,12 @@ LLVMValueRef define_const_string_literal(LLVMModuleRef mod, LLVMBuilderRef build
 	return g;
 }
 
-static size_t get_member_position(ast_decl *decl, strvec *name) {
-	vect *arglist = decl->typesym->type->arglist;
-	for (size_t i = 0 ; i < arglist->size ; ++i) {
-		if (strvec_equals(arglist_get(arglist, i)->symbol, name)) {
-			return i;
-		}
-	}
-	// LCOV_EXCL_START
-	eputs("DIDN'T FIND REQUESTED STRUCT MEMBER. FATAL ERROR.");
-	exit(1);
-	// LCOV_EXCL_STOP
-}
-
 static LLVMValueRef log_or_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr)
 {
 	LLVMValueRef cur_function = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-	LLVMBasicBlockRef L = LLVMAppendBasicBlock(cur_function, "L");
-	LLVMBasicBlockRef R = LLVMAppendBasicBlock(cur_function, "R");
-	LLVMBasicBlockRef C = LLVMAppendBasicBlock(cur_function, "C");
+	LLVMBasicBlockRef L = LLVMAppendBasicBlockInContext(CTXT(mod), cur_function, "L");
+	LLVMBasicBlockRef R = LLVMAppendBasicBlockInContext(CTXT(mod), cur_function, "R");
+	LLVMBasicBlockRef C = LLVMAppendBasicBlockInContext(CTXT(mod), cur_function, "C");
 	LLVMValueRef l_cond = expr_codegen(mod, builder, expr->left, 0);
 	LLVMBuildCondBr(builder, l_cond, L, R);
 
@@ -416,12 +686,14 @@ static LLVMValueRef log_or_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, as
 
 	LLVMPositionBuilderAtEnd(builder, R);
 	LLVMValueRef r_cond = expr_codegen(mod, builder, expr->right, 0);
+	// The right side may have branched (nested && / ||), so it doesn't necessarily end in R.
+	LLVMBasicBlockRef r_end = LLVMGetInsertBlock(builder);
 	LLVMBuildBr(builder, C);
 
 	LLVMPositionBuilderAtEnd(builder, C);
 	LLVMTypeRef bool_type = LLVMInt1TypeInContext(CTXT(mod));
 	LLVMValueRef phi = LLVMBuildPhi(builder, bool_type, "");
-	LLVMAddIncoming(phi, (LLVMValueRef[]){l_cond, r_cond}, (LLVMBasicBlockRef[]){L, R}, 2);
+	LLVMAddIncoming(phi, (LLVMValueRef[]){l_cond, r_cond}, (LLVMBasicBlockRef[]){L, r_end}, 2);
 
 	return phi;
 }
@@ -429,9 +701,9 @@ static LLVMValueRef log_or_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, as
 static LLVMValueRef log_and_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr)
 {
 	LLVMValueRef cur_function = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
-	LLVMBasicBlockRef L = LLVMAppendBasicBlock(cur_function, "L");
-	LLVMBasicBlockRef R = LLVMAppendBasicBlock(cur_function, "R");
-	LLVMBasicBlockRef C = LLVMAppendBasicBlock(cur_function, "C");
+	LLVMBasicBlockRef L = LLVMAppendBasicBlockInContext(CTXT(mod), cur_function, "L");
+	LLVMBasicBlockRef R = LLVMAppendBasicBlockInContext(CTXT(mod), cur_function, "R");
+	LLVMBasicBlockRef C = LLVMAppendBasicBlockInContext(CTXT(mod), cur_function, "C");
 	LLVMValueRef l_cond = expr_codegen(mod, builder, expr->left, 0);
 
 	// note R and L are flipped here from log_or.
@@ -445,12 +717,13 @@ static LLVMValueRef log_and_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, a
 
 	LLVMPositionBuilderAtEnd(builder, R);
 	LLVMValueRef r_cond = expr_codegen(mod, builder, expr->right, 0);
+	LLVMBasicBlockRef r_end = LLVMGetInsertBlock(builder);
 	LLVMBuildBr(builder, C);
 
 	LLVMPositionBuilderAtEnd(builder, C);
 	LLVMTypeRef bool_type = LLVMInt1TypeInContext(CTXT(mod));
 	LLVMValueRef phi = LLVMBuildPhi(builder, bool_type, "");
-	LLVMAddIncoming(phi, (LLVMValueRef[]){l_cond, r_cond}, (LLVMBasicBlockRef[]){L, R}, 2);
+	LLVMAddIncoming(phi, (LLVMValueRef[]){l_cond, r_cond}, (LLVMBasicBlockRef[]){L, r_end}, 2);
 
 	return phi;
 }
@@ -471,16 +744,16 @@ LLVMValueRef pre_unary_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_ex
 		return expr_codegen(mod, builder, expr->left, 1);
 	case T_MINUS:
 		v = expr_codegen(mod, builder, expr->left, 0);
-		return LLVMBuildSub(builder, LLVMConstInt(LLVMTypeOf(v), 0, 0), v, "");
+		return LLVMBuildSub(builder, LLVMConstNull(LLVMTypeOf(v)), v, "");
 	case T_BW_NOT:
 		v = expr_codegen(mod, builder, expr->left, 0);
-		return LLVMBuildXor(builder, LLVMConstInt(LLVMTypeOf(v), -1, 0), v, "");
+		return LLVMBuildXor(builder, LLVMConstAllOnes(LLVMTypeOf(v)), v, "");
 	case T_NOT:
 		v = expr_codegen(mod, builder, expr->left, 0);
 		return LLVMBuildXor(builder, LLVMConstInt(LLVMTypeOf(v), 1, 0), v, "");
 	case T_SIZEOF:
 		v = expr_codegen(mod, builder, expr->left, 0);
-		s = LLVMABISizeOfType(td, LLVMTypeOf(v));
+		s = LLVMABISizeOfType(cur_ctx->td, LLVMTypeOf(v));
 		// TODO: make a size_t/usize type that will vary with target triple or target
 		// data or whatever.
 		t = LLVMInt64TypeInContext(CTXT(mod));
@@ -493,10 +766,36 @@ LLVMValueRef pre_unary_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_ex
 	}
 }
 
+// Casting to a vector converts every lane of a vector, or broadcasts an integer to all
+// of the lanes.
+static LLVMValueRef vector_cast_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr)
+{
+	ast_type *from = expr->left->type;
+	ast_type *to = expr->type;
+	type_t from_elem = from->kind == Y_VECTOR ? from->subtype->kind : from->kind;
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(CTXT(mod));
+	LLVMTypeRef vt = to_llvm_type(mod, to);
+	LLVMTypeRef t = from->kind == Y_VECTOR ? vt : to_llvm_type(mod, to->subtype);
+	LLVMValueRef v = expr_codegen(mod, builder, expr->left, 0);
+
+	if (TYPE_WIDTH(to->subtype->kind) < TYPE_WIDTH(from_elem))
+		v = LLVMBuildTrunc(builder, v, t, "");
+	else if (TYPE_WIDTH(to->subtype->kind) > TYPE_WIDTH(from_elem) && IS_UNSIGNED(expr))
+		v = LLVMBuildZExt(builder, v, t, "");
+	else if (TYPE_WIDTH(to->subtype->kind) > TYPE_WIDTH(from_elem))
+		v = LLVMBuildSExt(builder, v, t, "");
+	if (from->kind == Y_VECTOR)
+		return v;
+	v = LLVMBuildInsertElement(builder, LLVMGetUndef(vt), v, LLVMConstInt(i32, 0, 0), "");
+	return LLVMBuildShuffleVector(builder, v, LLVMGetUndef(vt), LLVMConstNull(LLVMVectorType(i32, to->lanes)), "");
+}
+
 static LLVMValueRef cast_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr, int store_ctxt)
 {
 	ast_type *from_cast_t = expr->left->type;
 	ast_type *to_cast_t = expr->type;
+	if (to_cast_t->kind == Y_VECTOR)
+		return vector_cast_codegen(mod, builder, expr);
 	if (is_integer(from_cast_t) || from_cast_t->kind == Y_CHAR) {
 		if (is_integer(to_cast_t) || to_cast_t->kind == Y_CHAR) {
 			if (TYPE_WIDTH(to_cast_t->kind) < TYPE_WIDTH(from_cast_t->kind)) {
@@ -532,6 +831,76 @@ static LLVMValueRef cast_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_
 
 
 
+// See derive_vector_op. loadu and storeu only assume the elements' alignment.
+static LLVMValueRef vector_op_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr)
+{
+	vect *args = expr->sub_exprs;
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(CTXT(mod));
+	LLVMValueRef *mask;
+	LLVMValueRef p;
+	LLVMValueRef v;
+	LLVMValueRef v2;
+
+	switch (expr->op) {
+	case T_LOADU:
+		p = expr_codegen(mod, builder, args->elements[0], 0);
+		v = LLVMBuildLoad2(builder, to_llvm_type(mod, expr->type), p, "");
+		LLVMSetAlignment(v, LLVMABIAlignmentOfType(cur_ctx->td, to_llvm_type(mod, expr->type->subtype)));
+		return v;
+	case T_STOREU:
+		p = expr_codegen(mod, builder, args->elements[0], 0);
+		v = expr_codegen(mod, builder, args->elements[1], 0);
+		v = LLVMBuildStore(builder, v, p);
+		LLVMSetAlignment(v, LLVMABIAlignmentOfType(cur_ctx->td,
+				to_llvm_type(mod, ((ast_expr *)args->elements[1])->type->subtype)));
+		return v;
+	case T_SHUFFLE:
+		v = expr_codegen(mod, builder, args->elements[0], 0);
+		v2 = expr_codegen(mod, builder, args->elements[1], 0);
+		mask = smalloc((args->size - 2) * sizeof(*mask));
+		for (size_t i = 2 ; i < args->size ; ++i)
+			mask[i - 2] = LLVMConstInt(i32, ((ast_expr *)args->elements[i])->num, 0);
+		v = LLVMBuildShuffleVector(builder, v, v2, LLVMConstVector(mask, args->size - 2), "");
+		free(mask);
+		return v;
+	// LCOV_EXCL_START
+	default:
+		fprintf(stderr, "Can't codegen vector builtin with token %d\n", expr->op);
+		abort();
+	// LCOV_EXCL_STOP
+	}
+}
+
+static LLVMValueRef icmp_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr)
+{
+	if (expr->kind == E_EQUALITY) {
+		if (expr->op == T_EQ)
+			return LLVMBuildICmp(builder, LLVMIntEQ, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+		else
+			return LLVMBuildICmp(builder, LLVMIntNE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+	}
+	if (expr->op == T_LT)
+		if (IS_UNSIGNED(expr->left))
+			return LLVMBuildICmp(builder, LLVMIntULT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+		else
+			return LLVMBuildICmp(builder, LLVMIntSLT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+	else if (expr->op == T_LTE)
+		if (IS_UNSIGNED(expr->left))
+			return LLVMBuildICmp(builder, LLVMIntULE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+		else
+			return LLVMBuildICmp(builder, LLVMIntSLE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+	else if (expr->op == T_GT)
+		if (IS_UNSIGNED(expr->left))
+			return LLVMBuildICmp(builder, LLVMIntUGT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+		else
+			return LLVMBuildICmp(builder, LLVMIntSGT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+	else
+		if (IS_UNSIGNED(expr->left))
+			return LLVMBuildICmp(builder, LLVMIntUGE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+		else
+			return LLVMBuildICmp(builder, LLVMIntSGE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+}
+
 LLVMValueRef expr_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr, int store_ctxt)
 {
 	LLVMValueRef v;
@@ -591,22 +960,26 @@ LLVMValueRef expr_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *e
 	case E_LOG_AND:
 		return log_and_codegen(mod, builder, expr);
 	case E_EQUALITY:
-		if (expr->op == T_EQ)
-			return LLVMBuildICmp(builder, LLVMIntEQ, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-		else
-			return LLVMBuildICmp(builder, LLVMIntNE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
+	case E_INEQUALITY:
+		v = icmp_codegen(mod, builder, expr);
+		// Vectors compare lane by lane, true lanes are all ones (see derive_expr_type).
+		if (expr->type->kind == Y_VECTOR)
+			v = LLVMBuildSExt(builder, v, to_llvm_type(mod, expr->type), "");
+		return v;
 	case E_FNCALL:
-		v = LLVMGetNamedFunction(mod, expr->name->text);
+		v = cur_ctx->globals[expr->slot];
 		argno = LLVMCountParams(v);
 		get_fncall_args(mod, builder, expr, argno, &args, &argtypes);
 		LLVMTypeRef fn_t = LLVMFunctionType(to_llvm_type(mod, expr->type), argtypes, argno, 0);
 		return LLVMBuildCall2(builder, fn_t, v, args, argno, "");
 	case E_IDENTIFIER:
-		ret = scope_lookup(expr->name);
+		ret = expr->is_global ? cur_ctx->globals[expr->slot] : cur_ctx->locals[expr->slot];
 		if (!store_ctxt)
 			ret = LLVMBuildLoad2(builder, to_llvm_type(mod, expr->type), ret, "");
 		return ret;
 	case E_ASSIGN:
+		if (vector_lane(expr->left) != NULL)
+			return lane_assign_codegen(mod, builder, expr, vector_lane(expr->left));
 		v = expr_codegen(mod, builder, expr->left, 1);
 		return assign_codegen(mod, builder, expr, v);
 	case E_FALSE_LIT:
@@ -614,34 +987,20 @@ LLVMValueRef expr_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *e
 	case E_TRUE_LIT:
 		return LLVMConstInt(LLVMInt1TypeInContext(CTXT(mod)), 1, 0);
 	case E_STR_LIT:
-		return define_const_string_literal(mod, builder, expr->string_literal->text, expr->string_literal->size - 1);
+		return define_const_string_literal(mod, builder, expr->pooled);
 	case E_CHAR_LIT:
 		return LLVMConstInt(LLVMInt8TypeInContext(CTXT(mod)), (int)expr->string_literal->text[0], 0);
-	case E_INEQUALITY:
-		if (expr->op == T_LT)
-			if (IS_UNSIGNED(expr->left))
-				return LLVMBuildICmp(builder, LLVMIntULT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-			else
-				return LLVMBuildICmp(builder, LLVMIntSLT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-		else if (expr->op == T_LTE)
-			if (IS_UNSIGNED(expr->left))
-				return LLVMBuildICmp(builder, LLVMIntULE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-			else
-				return LLVMBuildICmp(builder, LLVMIntSLE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-		else if (expr->op == T_GT)
-			if (IS_UNSIGNED(expr->left))
-				return LLVMBuildICmp(builder, LLVMIntUGT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-			else
-				return LLVMBuildICmp(builder, LLVMIntSGT, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-		else
-			if (IS_UNSIGNED(expr->left))
-				return LLVMBuildICmp(builder, LLVMIntUGE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
-			else
-				return LLVMBuildICmp(builder, LLVMIntSGE, expr_codegen(mod, builder, expr->left, 0), expr_codegen(mod, builder, expr->right, 0), "");
 	case E_PAREN:
 		return expr_codegen(mod, builder, expr->left, store_ctxt);
+	case E_VECTOR_OP:
+		return vector_op_codegen(mod, builder, expr);
 	case E_POST_UNARY:
-		if (expr->op == T_LBRACKET) {
+		if (expr->op == T_LBRACKET && expr->left->type->kind == Y_VECTOR) {
+			// Lanes are only ever read here: writes go through lane_assign_codegen.
+			v = expr_codegen(mod, builder, expr->left, 0);
+			v2 = expr_codegen(mod, builder, expr->right, 0);
+			return LLVMBuildExtractElement(builder, v, v2, "");
+		} else if (expr->op == T_LBRACKET) {
 			v = expr_codegen(mod, builder, expr->left, 0);
 			v2 = expr_codegen(mod, builder, expr->right, 0);
 			v = LLVMBuildGEP2(builder, to_llvm_type(mod, expr->left->type->subtype), v, &v2, 1, "");
@@ -650,18 +1009,9 @@ LLVMValueRef expr_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *e
 			return v;
 		} else if (expr->op == T_PERIOD) {
 			v = expr_codegen(mod, builder, expr->left, 1);
-			// TODO: clean up all this to static back to strvec nonsense.
-			t = LLVMGetTypeByName2(CTXT(mod), expr->left->type->name->text);
-
-
-			// Look up the decl in sym tab so we can get field names
-			ast_decl *struct_decl;
-			struct_decl = scope_lookup(expr->left->type->name);
-
-			size_t ind = get_member_position(struct_decl, expr->right->name);
-
-			// set up gep indices
-			v2 = LLVMBuildStructGEP2(builder, t, v, ind, "");
+			struct llvm_struct *st = ht_get(cur_ctx->structs, expr->left->type->name);
+			struct_field *field = ht_get(st->def->fields, expr->right->name);
+			v2 = LLVMBuildStructGEP2(builder, st->type, v, field->pos, "");
 			if (!store_ctxt) {
 				return LLVMBuildLoad2(builder, to_llvm_type(mod, expr->type), v2, "");
 			}
@@ -706,47 +1056,44 @@ static void alloca_params_as_local_vars(LLVMBuilderRef builder, LLVMValueRef fn,
 		return;
 	for (size_t i = 0 ; i < arglist->size ; ++i) {
 		arg = LLVMGetParam(fn, i);
-		v = LLVMBuildAlloca(builder, param_types[i], arglist_get(arglist, i)->symbol->text);
+		v = entry_alloca(builder, param_types[i], arglist_get(arglist, i)->symbol->text);
 		LLVMBuildStore(builder, arg, v);
-		scope_bind(v, arglist_get(arglist,i)->symbol);
+		cur_ctx->locals[i] = v;
 	}
 }
 
 
 static void define_struct(LLVMModuleRef mod, ast_decl *decl) {
 	vect *al = decl->typesym->type->arglist;
-	size_t sz = al->size;
-	vect *members = vect_init(sz);
-
-	// A brief explaination of scope-binding structs:
-	// Structs can only be defined at the top level, so scope binding
-	//	them isn't reaaaally needed, but it's easier than keeping a
-	//	second list just for struct defs.
-	// Structs typesyms need to be accessible easily so that you can select struct fields
-	//	by name, as LLVM doesn't keep track of the field names. It only keeps track
-	//	of the types at each position.
-	// This could just bind the decl->typesym but who is keeping track anyways.
-	// Also don't free this decl! The symbol table does not own it!!
-	scope_bind(decl, decl->typesym->symbol);
-
-	LLVMTypeRef st_tp = LLVMStructCreateNamed(CTXT(mod), decl->typesym->symbol->text);
-	for (size_t i = 0 ; i < al->size ; ++i) {
-		LLVMTypeRef cur_type = to_llvm_type(mod, ((ast_typed_symbol *)vect_get(al, i))->type);
-		vect_append(members, cur_type);
-	}
-	LLVMStructSetBody(st_tp, (LLVMTypeRef *)members->elements, members->size, 0);
-	vect_destroy(members); // WARNING! Potential use-after-free situation?
-	// The type references themelves aren't freed
-	// but the array where the pointers are stored is within members->elements
-	// If LLVMStructSetBody creates a copy of the whole array / each pointer that's cool
-	// if LLVMStructSetBody itself holds onto a pointer to member->elements that
-	// could be a problem, as the data stored here will be overwritten etc.
+
+	// Repeated by another file of a whole program.
+	if (ht_get(cur_ctx->structs, decl->typesym->symbol) != NULL)
+		return;
+	LLVMTypeRef *members = malloc(al->size * sizeof(*members));
+	struct llvm_struct *st = smalloc(sizeof(*st));
+
+	for (size_t i = 0 ; i < al->size ; ++i)
+		members[i] = to_llvm_type(mod, arglist_get(al, i)->type);
+	st->type = LLVMStructCreateNamed(CTXT(mod), decl->typesym->symbol->text);
+	LLVMStructSetBody(st->type, members, al->size, 0);
+	st->def = decl->typesym->type;
+	ht_insert(cur_ctx->structs, decl->typesym->symbol, st);
+	free(members);
 }
 
 static void global_codegen(LLVMModuleRef mod, ast_decl *decl)
 {
 	LLVMValueRef v = LLVMAddGlobal(mod, to_llvm_type(mod, decl->typesym->type), decl->typesym->symbol->text);
 	LLVMValueRef initial = NULL;
+
+	cur_ctx->globals[decl->typesym->slot] = v;
+	// Split up, the first part defines the globals and the others refer to them, so
+	// they have to be visible across parts until module_link_parts puts them back.
+	if (cur_ctx->num_parts > 1) {
+		if (cur_ctx->part != 0)
+			return;
+		LLVMSetVisibility(v, LLVMHiddenVisibility);
+	}
 	switch (decl->typesym->type->kind) {
 	case Y_CHAR:
 		initial = LLVMConstInt(LLVMInt8TypeInContext(CTXT(mod)), (int)decl->expr->string_literal->text[0], 0);
@@ -772,6 +1119,7 @@ static void global_codegen(LLVMModuleRef mod, ast_decl *decl)
 	// LCOV_EXCL_START
 	case Y_FUNCTION:
 	case Y_STRUCT:
+	case Y_VECTOR:
 	case Y_VOID:
 		fprintf(stderr, "Could not declare a declaration of this type at the global level.");
 		exit(1);
@@ -779,33 +1127,72 @@ static void global_codegen(LLVMModuleRef mod, ast_decl *decl)
 	// LCOV_EXCL_STOP
 	}
 	LLVMSetInitializer(v, initial);
-	LLVMSetLinkage(v, LLVMPrivateLinkage);
+	if (cur_ctx->num_parts == 1)
+		LLVMSetLinkage(v, LLVMPrivateLinkage);
+}
 
-	scope_bind(v, decl->typesym->symbol);
+static int is_definition(ast_decl *decl)
+{
+	return decl->typesym->type->kind == Y_FUNCTION && decl->typesym->type->modif != VM_PROTO_DEFINED
+			&& decl->typesym->type->modif != VM_PROTO;
+}
+
+static int is_global_var(ast_decl *decl)
+{
+	type_t kind = decl->typesym->type->kind;
+	return kind != Y_FUNCTION && (kind != Y_STRUCT || decl->typesym->type->name != NULL);
+}
+
+static LLVMValueRef declare_function(LLVMModuleRef mod, ast_decl *decl, LLVMTypeRef *param_types)
+{
+	LLVMValueRef ret = cur_ctx->globals[decl->typesym->slot];
+	vect *arglist = decl->typesym->type->arglist;
+	size_t size = arglist == NULL ? 0 : arglist->size;
+
+	if (ret != NULL)
+		return ret;
+	LLVMTypeRef fn_type = LLVMFunctionType(to_llvm_type(mod, decl->typesym->type->subtype), param_types, size, 0);
+	ret = LLVMAddFunction(mod, decl->typesym->symbol->text, fn_type);
+	cur_ctx->globals[decl->typesym->slot] = ret;
+	return ret;
+}
+
+static void add_string_attribute(LLVMValueRef fn, const char *kind, const char *value)
+{
+	LLVMContextRef ctxt = LLVMGetModuleContext(LLVMGetGlobalParent(fn));
+	LLVMAttributeRef attr = LLVMCreateStringAttribute(ctxt, kind, strlen(kind), value, strlen(value));
+	LLVMAddAttributeAtIndex(fn, LLVMAttributeFunctionIndex, attr);
 }
 
 static void function_codegen(LLVMModuleRef mod, ast_decl *decl)
 {
-	char *sym_text = decl->typesym->symbol->text;
-	if (decl->typesym->type->modif == VM_PROTO_DEFINED || decl->typesym->type->modif == VM_PROTO) {
-		LLVMTypeRef *param_types = build_param_types(mod, decl);
-		vect *arglist = decl->typesym->type->arglist;
-		size_t size = arglist == NULL ? 0 : arglist->size;
-		LLVMTypeRef ret_type = LLVMFunctionType(to_llvm_type(mod, decl->typesym->type->subtype), param_types, size, 0);
-		LLVMAddFunction(mod, sym_text, ret_type);
-		free(param_types);
-		return;
-	}
-	LLVMValueRef fn_value = NULL;
 	LLVMTypeRef *param_types = build_param_types(mod, decl);
-	if ((fn_value = LLVMGetNamedFunction(mod, sym_text)) == NULL) {
-		vect *arglist = decl->typesym->type->arglist;
-		size_t size = arglist == NULL ? 0 : arglist->size;
-		LLVMTypeRef ret_type = LLVMFunctionType(to_llvm_type(mod, decl->typesym->type->subtype), param_types, size, 0);
-		fn_value = LLVMAddFunction(mod, sym_text, ret_type);
+	LLVMValueRef fn_value = declare_function(mod, decl, param_types);
+	size_t body;
+
+	// Prototypes, and definitions another part generates, are only declared.
+	if (!is_definition(decl))
+		goto out;
+	// Nothing outside of a whole program calls anything but main. Split up, the parts
+	// still call each other, so until module_link_parts they can only hide them.
+	if (cur_ctx->whole_program && strcmp(decl->typesym->symbol->text, "main") != 0) {
+		if (cur_ctx->num_parts == 1)
+			LLVMSetLinkage(fn_value, LLVMInternalLinkage);
+		else
+			LLVMSetVisibility(fn_value, LLVMHiddenVisibility);
 	}
-	scope_enter();
-	scope_bind_return_type(decl->typesym->type->subtype);
+	body = cur_ctx->next_body++;
+	if (body < cur_ctx->first_body || body >= cur_ctx->end_body)
+		goto out;
+
+	// Only when asked for, otherwise the JIT would be held to a generic CPU.
+	if (cur_ctx->cpu != NULL)
+		add_string_attribute(fn_value, "target-cpu", cur_ctx->target_cpu);
+	if (*cur_ctx->target_features != '\0')
+		add_string_attribute(fn_value, "target-features", cur_ctx->target_features);
+
+	cur_ctx->locals = scalloc(decl->num_locals, sizeof(*cur_ctx->locals));
+	cur_ctx->last_alloca = NULL;
 
 	LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(CTXT(mod), fn_value, "");
 	LLVMBuilderRef builder = LLVMCreateBuilderInContext(CTXT(mod));
@@ -815,6 +1202,10 @@ static void function_codegen(LLVMModuleRef mod, ast_decl *decl)
 
 	stmt_codegen(mod, builder, decl->body, NULL);
 	LLVMDisposeBuilder(builder);
+	free(cur_ctx->locals);
+	cur_ctx->locals = NULL;
+	cur_ctx->last_alloca = NULL;
+out:
 	free(param_types);
 }
 
@@ -830,3 +1221,149 @@ void decl_codegen(LLVMModuleRef *mod, ast_decl *decl)
 		global_codegen(*mod, decl);
 	}
 }
+
+static int part_codegen(void *arg)
+{
+	codegen_part *p = arg;
+	char *error = NULL;
+
+	p->ctxt = LLVMContextCreate();
+	p->mod = module_codegen(&p->c, p->ctxt, p->program, p->module_name);
+	LLVMVerifyModule(p->mod, LLVMAbortProcessAction, &error);
+	LLVMDisposeMessage(error);
+	module_optimize(&p->c, p->mod);
+	if (p->obj != NULL) {
+		error = NULL;
+		if (!p->c.had_error && LLVMTargetMachineEmitToFile(p->c.tm, p->mod, p->obj, LLVMObjectFile, &error)) {
+			fprintf(stderr, "Could not write \"%s\": %s\n", p->obj, error);
+			LLVMDisposeMessage(error);
+			p->c.had_error = 1;
+		}
+		LLVMDisposeModule(p->mod);
+		LLVMContextDispose(p->ctxt);
+		p->mod = NULL;
+		p->ctxt = NULL;
+	}
+	LLVMDisposeTargetData(p->c.td);
+	LLVMDisposeTargetMachine(p->c.tm);
+	free(p->c.target_cpu);
+	free(p->c.target_features);
+	return 0;
+}
+
+int module_codegen_parallel(compile_ctx *c, ast_decl *program, char *module_name, codegen_part *parts, size_t num_parts)
+{
+	thrd_t *threads = smalloc(num_parts * sizeof(*threads));
+	int *started = scalloc(num_parts, sizeof(*started));
+	size_t bodies = 0;
+	int had_error = 0;
+
+	for (ast_decl *d = program ; d != NULL ; d = d->next)
+		bodies += is_definition(d);
+	for (size_t i = 0 ; i < num_parts ; ++i) {
+		parts[i].c = *c;
+		parts[i].c.had_error = 0;
+		parts[i].c.tm = NULL;
+		parts[i].c.td = NULL;
+		parts[i].c.target_cpu = NULL;
+		parts[i].c.target_features = NULL;
+		parts[i].c.part = i;
+		parts[i].c.num_parts = num_parts;
+		parts[i].c.first_body = bodies * i / num_parts;
+		parts[i].c.end_body = bodies * (i + 1) / num_parts;
+		parts[i].program = program;
+		parts[i].module_name = module_name;
+		started[i] = thrd_create(&threads[i], part_codegen, &parts[i]) == thrd_success;
+		// No thread to spare: do it here instead.
+		if (!started[i])
+			part_codegen(&parts[i]);
+	}
+	for (size_t i = 0 ; i < num_parts ; ++i) {
+		if (started[i])
+			thrd_join(threads[i], NULL);
+		had_error |= parts[i].c.had_error;
+	}
+	cur_ctx = c;
+	free(started);
+	free(threads);
+	return had_error;
+}
+
+// Each part pools its string literals on its own, so once they're linked a literal can
+// have a copy per part. Keeps the first and points the other copies' uses at it.
+static void merge_string_literals(LLVMModuleRef mod)
+{
+	struct ht *seen = ht_init(64, NULL);
+	LLVMValueRef g = LLVMGetFirstGlobal(mod);
+
+	while (g != NULL) {
+		LLVMValueRef next = LLVMGetNextGlobal(g);
+		LLVMValueRef init = LLVMGetInitializer(g);
+		LLVMValueRef first;
+		const char *text;
+		size_t len;
+		istr *key;
+
+		if (LLVMGetLinkage(g) == LLVMPrivateLinkage && LLVMIsGlobalConstant(g)
+				&& LLVMGetUnnamedAddress(g) == LLVMGlobalUnnamedAddr
+				&& init != NULL && LLVMIsAConstantDataSequential(init) && LLVMIsConstantString(init)) {
+			text = LLVMGetAsString(init, &len);
+			key = intern(text, len);
+			if ((first = ht_get(seen, key)) == NULL) {
+				ht_insert(seen, key, g);
+			} else {
+				LLVMReplaceAllUsesWith(g, first);
+				LLVMDeleteGlobal(g);
+			}
+		}
+		g = next;
+	}
+	ht_destroy(seen);
+}
+
+LLVMModuleRef module_link_parts(compile_ctx *c, LLVMContextRef ctxt, ast_decl *program, char *module_name,
+		codegen_part *parts, size_t num_parts)
+{
+	LLVMModuleRef ret = LLVMModuleCreateWithNameInContext(module_name, ctxt);
+	char *triple;
+
+	cur_ctx = c;
+	target_init(c);
+	triple = LLVMGetTargetMachineTriple(c->tm);
+	LLVMSetTarget(ret, triple);
+	LLVMDisposeMessage(triple);
+	LLVMSetModuleDataLayout(ret, c->td);
+
+	// Modules can only be linked within one context, so each part makes a trip through
+	// bitcode to get into ctxt.
+	for (size_t i = 0 ; i < num_parts ; ++i) {
+		LLVMMemoryBufferRef buf = LLVMWriteBitcodeToMemoryBuffer(parts[i].mod);
+		LLVMModuleRef part;
+
+		LLVMDisposeModule(parts[i].mod);
+		LLVMContextDispose(parts[i].ctxt);
+		parts[i].mod = NULL;
+		parts[i].ctxt = NULL;
+		if (LLVMParseBitcodeInContext2(ctxt, buf, &part) || LLVMLinkModules2(ret, part)) {
+			fprintf(stderr, "Could not link part %zu of %s\n", i, module_name);
+			c->had_error = 1;
+		}
+		LLVMDisposeMemoryBuffer(buf);
+	}
+
+	// The parts had to see each other's globals, and a whole program's functions,
+	// nothing else should.
+	for (ast_decl *d = program ; d != NULL ; d = d->next) {
+		LLVMValueRef g;
+		if (is_global_var(d) && (g = LLVMGetNamedGlobal(ret, d->typesym->symbol->text)) != NULL) {
+			LLVMSetLinkage(g, LLVMPrivateLinkage);
+			LLVMSetVisibility(g, LLVMDefaultVisibility);
+		} else if (c->whole_program && is_definition(d) && strcmp(d->typesym->symbol->text, "main") != 0
+				&& (g = LLVMGetNamedFunction(ret, d->typesym->symbol->text)) != NULL) {
+			LLVMSetLinkage(g, LLVMInternalLinkage);
+			LLVMSetVisibility(g, LLVMDefaultVisibility);
+		}
+	}
+	merge_string_literals(ret);
+	return ret;
+}
@@ -2,14 +2,39 @@
 #define CODEGEN_H
 
 #include "ast.h"
+#include "compiler.h"
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/BitWriter.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 
-LLVMModuleRef module_codegen(LLVMContextRef ctxt, ast_decl *start, char *module_name);
+// Builds c's target machine from its -march/-mcpu and -mattr, unless it already has one.
+void target_init(compile_ctx *c);
+LLVMModuleRef module_codegen(compile_ctx *c, LLVMContextRef ctxt, ast_decl *start, char *module_name);
+void module_optimize(compile_ctx *c, LLVMModuleRef mod);
+
+// One thread's share of a program under -j: its own context and module, generated from
+// its own copy of the compile_ctx. If obj is set, the part is also emitted there as an
+// object file and its module and context are disposed of.
+typedef struct codegen_part {
+	compile_ctx c;
+	LLVMContextRef ctxt;
+	LLVMModuleRef mod;
+	ast_decl *program;
+	char *module_name;
+	char *obj;
+} codegen_part;
+
+// Splits the function definitions of program into num_parts runs of about the same
+// length and generates, verifies and optimizes each part on its own thread. Functions
+// are only inlined into callers in the same part. Returns nonzero if a part failed.
+int module_codegen_parallel(compile_ctx *c, ast_decl *program, char *module_name, codegen_part *parts, size_t num_parts);
+// Links parts that weren't emitted as objects into a single module in ctxt.
+LLVMModuleRef module_link_parts(compile_ctx *c, LLVMContextRef ctxt, ast_decl *program, char *module_name,
+		codegen_part *parts, size_t num_parts);
 void decl_codegen(LLVMModuleRef *mod, ast_decl *decl);
 void stmt_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_stmt *stmt, LLVMBasicBlockRef p_con);
 LLVMValueRef expr_codegen(LLVMModuleRef mod, LLVMBuilderRef builder, ast_expr *expr, int store_ctxt);
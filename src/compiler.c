@@ -0,0 +1,72 @@
+#include "compiler.h"
+#include "intern.h"
+#include "symbol_table.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdint.h>
+
+_Thread_local compile_ctx *cur_ctx = NULL;
+
+compile_ctx *compile_ctx_init(void)
+{
+	compile_ctx *ret = smalloc(sizeof(*ret));
+	ret->had_error = 0;
+	ret->opt_level = OPT_O0;
+	ret->whole_program = 0;
+	ret->file = NULL;
+	ret->interner = intern_init();
+	ret->types = types_init();
+	ret->ast_arena = arena_init(64 * 1024);
+	ret->sym_tab = NULL;
+	ret->toks = NULL;
+	ret->cur_tok = 0;
+	ret->prev_tok = 0;
+	ret->in_loop = 0;
+	ret->cur_line = 0;
+	ret->num_globals = 0;
+	ret->num_locals = 0;
+	ret->tm = NULL;
+	ret->td = NULL;
+	ret->cpu = NULL;
+	ret->features = NULL;
+	ret->target_cpu = NULL;
+	ret->target_features = NULL;
+	ret->structs = NULL;
+	ret->strings = NULL;
+	ret->globals = NULL;
+	ret->locals = NULL;
+	ret->last_alloca = NULL;
+	ret->part = 0;
+	ret->num_parts = 1;
+	ret->first_body = 0;
+	ret->end_body = SIZE_MAX;
+	ret->next_body = 0;
+	return ret;
+}
+
+void compile_ctx_destroy(compile_ctx *c)
+{
+	if (c == NULL)
+		return;
+	intern_destroy(c->interner);
+	types_destroy(c->types);
+	arena_destroy(c->ast_arena);
+	if (c->td != NULL)
+		LLVMDisposeTargetData(c->td);
+	if (c->tm != NULL)
+		LLVMDisposeTargetMachine(c->tm);
+	free(c->target_cpu);
+	free(c->target_features);
+	if (cur_ctx == c)
+		cur_ctx = NULL;
+	free(c);
+}
+
+void compile_ctx_drop_ast(compile_ctx *c)
+{
+	types_destroy(c->types);
+	arena_destroy(c->ast_arena);
+	c->types = types_init();
+	c->ast_arena = arena_init(64 * 1024);
+}
@@ -0,0 +1,89 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "arena.h"
+#include "token.h"
+
+#include <stddef.h>
+
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+
+struct ht;
+struct interner;
+struct type_table;
+struct stack;
+
+typedef enum {
+	OPT_O0,
+	OPT_O1,
+	OPT_O2,
+	OPT_O3,
+	OPT_OS,
+} opt_level_t;
+
+// Everything that belongs to one compilation. The entry points (scan, parse_program,
+// typecheck_program, module_codegen) take a context and make it the calling thread's
+// cur_ctx, so separate compilations can run in separate threads at the same time.
+typedef struct compile_ctx {
+	int had_error;
+	opt_level_t opt_level;
+	// Set when several files are compiled together into one program. Then the files'
+	// shared headers may declare the same protos and structs more than once, and nothing
+	// but main has to be visible outside of the program.
+	int whole_program;
+	// The file being scanned, parsed or checked. Errors name it if it's set, which
+	// it only is when there's more than one.
+	const char *file;
+	struct interner *interner;
+	struct type_table *types;
+	arena *ast_arena;
+	struct stack *sym_tab;
+
+	// parser
+	token_list *toks;
+	size_t cur_tok;
+	size_t prev_tok;
+
+	// typechecker
+	int in_loop;
+	int cur_line;
+	size_t num_globals;
+	size_t num_locals;
+
+	// codegen. The target machine is created by the first module_codegen and kept
+	// around until the context is destroyed.
+	LLVMTargetMachineRef tm;
+	LLVMTargetDataRef td;
+	// What -march/-mcpu and -mattr asked for, NULL if they weren't given. target_init
+	// resolves them (e.g. "native") into target_cpu and target_features, which are
+	// what the target machine and the functions' attributes use.
+	const char *cpu;
+	const char *features;
+	char *target_cpu;
+	char *target_features;
+	struct ht *structs; // struct name -> struct llvm_struct, see codegen.c
+	struct ht *strings; // interned string literal -> its global, see codegen.c
+	LLVMValueRef *globals; // by slot, see ast_typed_symbol
+	LLVMValueRef *locals; // of the function being generated, by slot
+	LLVMValueRef last_alloca; // in that function's entry block, see entry_alloca
+
+	// With -j the program is generated in parts, each by its own thread from its own copy
+	// of the context. A part generates the bodies of the function definitions numbered
+	// [first_body, end_body) in program order and only declares the rest. See
+	// module_codegen_parallel.
+	size_t part;
+	size_t num_parts;
+	size_t first_body;
+	size_t end_body;
+	size_t next_body;
+} compile_ctx;
+
+extern _Thread_local compile_ctx *cur_ctx;
+
+compile_ctx *compile_ctx_init(void);
+void compile_ctx_destroy(compile_ctx *c);
+// Frees the AST (and the types, which live in it) but keeps the interned identifiers.
+void compile_ctx_drop_ast(compile_ctx *c);
+
+#endif
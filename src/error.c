@@ -1,22 +1,27 @@
+#include "compiler.h"
 #include "error.h"
 
 #include <stdio.h>
 #include <unistd.h>
 
-int had_error = 0;
-
+static void print_file(void)
+{
+	if (cur_ctx->file != NULL)
+		fprintf(stderr, "%s: ", cur_ctx->file);
+}
 
-void report_error_tok(token_s *t, const char *fmt, ...)
+void report_error_tok(token_list *toks, size_t i, const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	report_error(t->line, t->col, fmt, args);
+	vreport_error(toks->line[i], toks->col[i], fmt, args);
 	va_end(args);
 }
 
 void vreport_error(size_t line, size_t col, const char *fmt, va_list args)
 {
-	had_error = 1;
+	cur_ctx->had_error = 1;
+	print_file();
 	fprintf(stderr, "[line %lu col %lu] ", line, col);
 	vfprintf(stderr, fmt, args);
 }
@@ -24,7 +29,8 @@ void vreport_error(size_t line, size_t col, const char *fmt, va_list args)
 void report_error(size_t line, size_t col, const char *fmt, ...)
 {
 	va_list args;
-	had_error = 1;
+	cur_ctx->had_error = 1;
+	print_file();
 	fprintf(stderr, "[line %lu col %lu] ", line, col);
 	va_start(args, fmt);
 	vfprintf(stderr, fmt, args);
@@ -34,7 +40,8 @@ void report_error(size_t line, size_t col, const char *fmt, ...)
 void report_error_line(size_t line, const char *fmt, ...)
 {
 	va_list args;
-	had_error = 1;
+	cur_ctx->had_error = 1;
+	print_file();
 	fprintf(stderr, "[line %lu] ", line);
 	va_start(args, fmt);
 	vfprintf(stderr, fmt, args);
@@ -43,7 +50,8 @@ void report_error_line(size_t line, const char *fmt, ...)
 
 void vreport_error_line(size_t line, const char *fmt, va_list args)
 {
-	had_error = 1;
+	cur_ctx->had_error = 1;
+	print_file();
 	fprintf(stderr, "[line %lu] ", line);
 	vfprintf(stderr, fmt, args);
 }
@@ -1,78 +1,94 @@
 #include "ht.h"
 
-uint64_t hash(strvec *str)
+uint64_t hash(const char *text, size_t len)
 {
 	// FNV offset basis, per
 	// https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function
 	uint64_t hash = 14695981039346656037UL;
 	size_t i;
 
-	for (i = 0; i < str->size; ++i) {
-		hash ^= str->text[i];
+	for (i = 0; i < len; ++i) {
+		hash ^= text[i];
 		// FNV_prime, also from above wikipedia article.
 		hash *= 1099511628211;
 	}
 	return hash;
 }
 
+// FNV's low bits only depend on the low bits of the input, fold the high half in
+// before masking.
+static inline size_t home_slot(istr *key, size_t capacity)
+{
+	return (key->hash ^ (key->hash >> 32)) & (capacity - 1);
+}
+
+static size_t round_up_pow2(size_t n)
+{
+	size_t ret = HT_INLINE_CAP;
+	while (ret < n)
+		ret *= 2;
+	return ret;
+}
+
+void ht_init_embedded(struct ht *tab, size_t capacity, void (*destroyer)(void *))
+{
+	tab->capacity = round_up_pow2(capacity);
+	if (tab->capacity == HT_INLINE_CAP) {
+		tab->data = tab->inline_data;
+		for (size_t i = 0 ; i < HT_INLINE_CAP ; ++i)
+			tab->inline_data[i].key = NULL;
+	} else {
+		tab->data = scalloc(tab->capacity, sizeof(*tab->data));
+	}
+	tab->num_elements = 0;
+	tab->element_destroyer = destroyer;
+}
+
 struct ht *ht_init(size_t capacity, void (*destroyer)(void *))
 {
 	struct ht *ret = smalloc(sizeof(*ret));
-	ret->data = scalloc(capacity, sizeof(*ret->data));
-	ret->capacity = capacity;
-	ret->num_elements = 0;
-	ret->element_destroyer = destroyer;
-
+	ht_init_embedded(ret, capacity, destroyer);
 	return ret;
 }
 
-static int insert(struct kv **data, size_t cap, uint64_t key_hash, void *value)
+static int insert(struct kv *data, size_t cap, istr *key, void *value)
 {
-	size_t index = key_hash % cap;
-	while (data[index] != NULL) {
-		if (data[index]->key == key_hash)
+	size_t mask = cap - 1;
+	size_t index = home_slot(key, cap);
+	while (data[index].key != NULL) {
+		if (data[index].key == key)
 			return 0;
-		index = (index + 1) % cap;
+		index = (index + 1) & mask;
 	}
-	data[index] = smalloc(sizeof(**(data)));
-	data[index]->key = key_hash;
-	data[index]->val = value;
+	data[index].key = key;
+	data[index].val = value;
 	return 1;
 }
 
-int ht_insert(struct ht *tab, strvec *key, void *value)
+int ht_insert(struct ht *tab, istr *key, void *value)
 {
 	if (tab->num_elements >= tab->capacity * 3 / 4)
 		ht_resize(tab, tab->capacity * 2);
-	if (insert(tab->data, tab->capacity, hash(key), value)) {
+	if (insert(tab->data, tab->capacity, key, value)) {
 		tab->num_elements += 1;
 		return 1;
 	}
 	return 0;
 }
 
-static void ht_data_destroy(struct ht *tab) {
-	for (size_t i = 0 ; i < tab->capacity ; ++i) {
-		if (tab->data[i] != NULL)
-			tab->element_destroyer(tab->data[i]);
-		free(tab->data[i]);
-	}
-	free(tab->data);
-}
-
 int ht_resize(struct ht *tab, size_t new_cap)
 {
-	struct kv **new_data;
-	if (new_cap < tab->capacity)
+	struct kv *new_data;
+	new_cap = round_up_pow2(new_cap);
+	if (new_cap <= tab->capacity)
 		return 0;
 	new_data = scalloc(new_cap, sizeof(*new_data));
 	for (size_t i = 0; i < tab->capacity; ++i) {
-		struct kv *entry = tab->data[i];
-		if (tab->data[i] == NULL)
-			continue;
-		insert(new_data, new_cap, entry->key, entry->val);
+		if (tab->data[i].key != NULL)
+			insert(new_data, new_cap, tab->data[i].key, tab->data[i].val);
 	}
-	ht_data_destroy(tab);
+	if (tab->data != tab->inline_data)
+		free(tab->data);
 	tab->data = new_data;
 	tab->capacity = new_cap;
 
@@ -82,28 +98,35 @@ int ht_resize(struct ht *tab, size_t new_cap)
 /**
  * Get the element with key 'key' from hashtable `tab`
  */
-void *ht_get(struct ht *tab, strvec *key)
+void *ht_get(struct ht *tab, istr *key)
 {
-	uint64_t key_hash = hash(key);
-	size_t index = key_hash % tab->capacity;
-	size_t i = 0;
-	while (i < tab->capacity) {
-		struct kv *entry = tab->data[index];
-		if (entry == NULL)
-			return NULL;
-		if (entry->key == key_hash)
-			return entry->val;
-		++index;
-		index %= tab->capacity;
-		++i;
+	size_t mask = tab->capacity - 1;
+	size_t index = home_slot(key, tab->capacity);
+	// The load factor is capped at 3/4, so there's always an empty slot to stop at.
+	while (tab->data[index].key != NULL) {
+		if (tab->data[index].key == key)
+			return tab->data[index].val;
+		index = (index + 1) & mask;
 	}
-	// failsafe tab->capacity limit SHOULD be unnecessary!
 	return NULL;
 }
+
+void ht_destroy_embedded(struct ht *tab)
+{
+	if (tab->element_destroyer != NULL) {
+		for (size_t i = 0 ; i < tab->capacity ; ++i) {
+			if (tab->data[i].key != NULL)
+				tab->element_destroyer(tab->data[i].val);
+		}
+	}
+	if (tab->data != tab->inline_data)
+		free(tab->data);
+}
+
 void ht_destroy(struct ht *tab)
 {
 	if (tab == NULL)
 		return;
-	ht_data_destroy(tab);
+	ht_destroy_embedded(tab);
 	free(tab);
 }
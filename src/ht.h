@@ -1,28 +1,42 @@
 #ifndef HT_H
 #define HT_H
 
+#include "intern.h"
 #include "util.h"
 
 #include <stddef.h>
 #include <stdint.h>
 
-uint64_t hash(strvec *str);
+// Small tables (which is most scopes) fit in the entries embedded in struct ht
+// and never allocate a separate array.
+#define HT_INLINE_CAP 8
 
+uint64_t hash(const char *text, size_t len);
+
+// Keys are interned, so they're hashed once by the interner and compared by pointer.
+// A NULL key marks an empty slot.
 struct kv {
-	uint64_t key;
+	istr *key;
 	void *val;
 };
 
+// Open addressing with linear probing. Entries live inline in `data`, whose
+// capacity is always a power of two.
 struct ht {
-	struct kv **data;
+	struct kv *data;
 	size_t capacity;
 	size_t num_elements;
 	void (*element_destroyer)(void *);
+	struct kv inline_data[HT_INLINE_CAP];
 };
 
+// destroyer is called on every value when the table is destroyed. It may be NULL.
 struct ht *ht_init(size_t capacity, void (*destroyer)(void *));
-int ht_insert(struct ht *tab, strvec *key, void *value);
-void *ht_get(struct ht *tab, strvec *key);
+// Same as ht_init/ht_destroy, for a table that is embedded in some other struct.
+void ht_init_embedded(struct ht *tab, size_t capacity, void (*destroyer)(void *));
+void ht_destroy_embedded(struct ht *tab);
+int ht_insert(struct ht *tab, istr *key, void *value);
+void *ht_get(struct ht *tab, istr *key);
 int ht_resize(struct ht *tab, size_t new_cap);
 // Freeing the hash table is NO LONGER left as an exercise for the reader!
 // Simply provide a means of destroying the elements in the hash table!
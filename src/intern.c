@@ -0,0 +1,81 @@
+#include "arena.h"
+#include "compiler.h"
+#include "ht.h"
+#include "intern.h"
+#include "util.h"
+
+#include <string.h>
+
+struct interner {
+	istr **slots;
+	size_t capacity;
+	size_t num_elements;
+	arena *strings;
+};
+
+struct interner *intern_init(void)
+{
+	struct interner *ret = smalloc(sizeof(*ret));
+	ret->capacity = 1024;
+	ret->num_elements = 0;
+	ret->slots = scalloc(ret->capacity, sizeof(*ret->slots));
+	ret->strings = arena_init(64 * 1024);
+	return ret;
+}
+
+void intern_destroy(struct interner *in)
+{
+	if (in == NULL)
+		return;
+	free(in->slots);
+	arena_destroy(in->strings);
+	free(in);
+}
+
+static void grow(struct interner *interner)
+{
+	size_t new_cap = interner->capacity * 2;
+	istr **new_slots = scalloc(new_cap, sizeof(*new_slots));
+	for (size_t i = 0 ; i < interner->capacity ; ++i) {
+		istr *s = interner->slots[i];
+		if (s == NULL)
+			continue;
+		size_t index = s->hash & (new_cap - 1);
+		while (new_slots[index] != NULL)
+			index = (index + 1) & (new_cap - 1);
+		new_slots[index] = s;
+	}
+	free(interner->slots);
+	interner->slots = new_slots;
+	interner->capacity = new_cap;
+}
+
+istr *intern(const char *text, size_t len)
+{
+	struct interner *interner = cur_ctx->interner;
+	uint64_t h = hash(text, len);
+	size_t index;
+	istr *s;
+
+	if (interner->num_elements >= interner->capacity * 3 / 4)
+		grow(interner);
+	index = h & (interner->capacity - 1);
+	while ((s = interner->slots[index]) != NULL) {
+		if (s->hash == h && s->len == len && !memcmp(s->text, text, len))
+			return s;
+		index = (index + 1) & (interner->capacity - 1);
+	}
+	s = arena_alloc(interner->strings, sizeof(*s) + len + 1);
+	s->hash = h;
+	s->len = len;
+	memcpy(s->text, text, len);
+	s->text[len] = '\0';
+	interner->slots[index] = s;
+	interner->num_elements++;
+	return s;
+}
+
+istr *intern_str(const char *text)
+{
+	return intern(text, strlen(text));
+}
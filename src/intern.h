@@ -0,0 +1,23 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// An interned string. There is exactly one istr for any given text, so two
+// istrs are equal if and only if they are the same pointer.
+typedef struct istr {
+	uint64_t hash;
+	size_t len;
+	char text[];
+} istr;
+
+struct interner;
+
+// Interning goes through the current compilation's interner (see compiler.h).
+struct interner *intern_init(void);
+void intern_destroy(struct interner *in);
+istr *intern(const char *text, size_t len);
+istr *intern_str(const char *text);
+
+#endif
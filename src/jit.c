@@ -0,0 +1,98 @@
+#include "jit.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <llvm-c/Error.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Orc.h>
+#include <llvm-c/Target.h>
+
+struct jit {
+	LLVMOrcLLJITRef lljit;
+	LLVMOrcThreadSafeContextRef tsctx;
+	LLVMOrcJITDylibRef dylib;
+};
+
+static void report(LLVMErrorRef e)
+{
+	char *msg = LLVMGetErrorMessage(e);
+	fprintf(stderr, "JIT error: %s\n", msg);
+	LLVMDisposeErrorMessage(msg);
+}
+
+jit *jit_init(void)
+{
+	jit *ret = smalloc(sizeof(*ret));
+	LLVMOrcDefinitionGeneratorRef gen;
+	LLVMErrorRef e;
+
+	LLVMInitializeNativeTarget();
+	LLVMInitializeNativeAsmPrinter();
+	// For inline asm.
+	LLVMInitializeNativeAsmParser();
+	e = LLVMOrcCreateLLJIT(&ret->lljit, NULL);
+	if (e != NULL)
+		goto error;
+	ret->dylib = LLVMOrcLLJITGetMainJITDylib(ret->lljit);
+	e = LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(&gen,
+			LLVMOrcLLJITGetGlobalPrefix(ret->lljit), NULL, NULL);
+	if (e != NULL)
+		goto error_lljit;
+	LLVMOrcJITDylibAddGenerator(ret->dylib, gen);
+	ret->tsctx = LLVMOrcCreateNewThreadSafeContext();
+	return ret;
+
+error_lljit:
+	LLVMOrcDisposeLLJIT(ret->lljit);
+error:
+	report(e);
+	free(ret);
+	return NULL;
+}
+
+void jit_destroy(jit *j)
+{
+	LLVMErrorRef e = LLVMOrcDisposeLLJIT(j->lljit);
+	if (e != NULL)
+		report(e);
+	LLVMOrcDisposeThreadSafeContext(j->tsctx);
+	free(j);
+}
+
+LLVMContextRef jit_context(jit *j)
+{
+	return LLVMOrcThreadSafeContextGetContext(j->tsctx);
+}
+
+int jit_run_main(jit *j, LLVMModuleRef mod, int *ret)
+{
+	LLVMOrcResourceTrackerRef rt = LLVMOrcJITDylibCreateResourceTracker(j->dylib);
+	LLVMOrcThreadSafeModuleRef tsm = LLVMOrcCreateNewThreadSafeModule(mod, j->tsctx);
+	LLVMOrcExecutorAddress addr;
+	LLVMErrorRef e;
+	int had_error = 1;
+
+	e = LLVMOrcLLJITAddLLVMIRModuleWithRT(j->lljit, rt, tsm);
+	if (e != NULL)
+		goto error;
+	e = LLVMOrcLLJITLookup(j->lljit, &addr, "main");
+	if (e == NULL) {
+		*ret = ((int (*)(void))(uintptr_t)addr)();
+		had_error = 0;
+	} else {
+		report(e);
+	}
+
+	// Drop the module's code and symbols so the next module can have its own main.
+	e = LLVMOrcResourceTrackerRemove(rt);
+error:
+	if (e != NULL) {
+		report(e);
+		had_error = 1;
+	}
+	LLVMOrcReleaseResourceTracker(rt);
+	return had_error;
+}
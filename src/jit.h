@@ -0,0 +1,22 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <llvm-c/Core.h>
+
+// An in-process ORC LLJIT session. One session can run any number of modules one after
+// the other: each module is compiled, its main is called and then it is removed again,
+// so the next module can define main (or anything else) afresh. Symbols the modules
+// don't define are looked up in the host process (libc and so on).
+typedef struct jit jit;
+
+jit *jit_init(void);
+void jit_destroy(jit *j);
+
+// Modules passed to jit_run_main have to be created in this context.
+LLVMContextRef jit_context(jit *j);
+
+// Takes ownership of mod, calls its main and stores the result in *ret. Returns nonzero
+// (after printing what went wrong) if the module couldn't be compiled or has no main.
+int jit_run_main(jit *j, LLVMModuleRef mod, int *ret);
+
+#endif
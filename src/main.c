@@ -1,9 +1,10 @@
 #include "ast.h"
 #include "codegen.h"
+#include "compiler.h"
 #include "error.h"
+#include "jit.h"
 #include "parse.h"
 #include "scan.h"
-#include "symbol_table.h"
 #include "token.h"
 #include "typecheck.h"
 #include "util.h"
@@ -12,37 +13,319 @@
 #include <err.h>
 #include <libgen.h>
 #include <limits.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <llvm-c/Core.h>
 
-extern int had_error;
-extern struct stack *sym_tab;
+extern char **environ;
+
+typedef enum {
+	OUT_BITCODE,
+	OUT_OBJECT,
+	OUT_ASSEMBLY,
+	OUT_EXECUTABLE,
+} output_t;
+
+static const char *default_outfile[] = {
+	[OUT_BITCODE] = "a.bc",
+	[OUT_OBJECT] = "a.o",
+	[OUT_ASSEMBLY] = "a.s",
+	[OUT_EXECUTABLE] = "a.out",
+};
+
+#define TMP_OBJ "/tmp/objXXXXXX"
 
 char *cmd = NULL;
 
+static opt_level_t parse_opt_level(const char *arg)
+{
+	if (arg[0] != '\0' && arg[1] == '\0') {
+		switch (arg[0]) {
+		case '0':
+			return OPT_O0;
+		case '1':
+			return OPT_O1;
+		case '2':
+			return OPT_O2;
+		case '3':
+			return OPT_O3;
+		case 's':
+			return OPT_OS;
+		}
+	}
+	fprintf(stderr, "%s: Unknown optimization level '-O%s'\n", cmd, arg);
+	exit(1);
+}
+
+static size_t parse_jobs(const char *arg)
+{
+	char *end;
+	long ret = strtol(arg, &end, 10);
+
+	if (*arg == '\0' || *end != '\0' || ret < 1 || ret > 256) {
+		fprintf(stderr, "%s: Invalid number of jobs '%s'\n", cmd, arg);
+		exit(1);
+	}
+	return ret;
+}
+
+// -march= and -mcpu= both pick the CPU (the way clang treats -march on x86), -mattr=
+// takes an LLVM feature string like "+avx2,-bmi". Any of them can be "native".
+static void parse_target_option(const char *arg, const char **cpu, const char **features)
+{
+	if (strncmp(arg, "arch=", 5) == 0 && arg[5] != '\0')
+		*cpu = arg + 5;
+	else if (strncmp(arg, "cpu=", 4) == 0 && arg[4] != '\0')
+		*cpu = arg + 4;
+	else if (strncmp(arg, "attr=", 5) == 0)
+		*features = arg + 5;
+	else {
+		fprintf(stderr, "%s: Unknown option '-m%s'\n", cmd, arg);
+		exit(1);
+	}
+}
+
 static void usage(void)
 {
-	fprintf(stderr, "%s usage: %s input_file [-o output_file]\n", cmd, cmd);
+	fprintf(stderr, "%s usage: %s input_file... [-o output_file] [-c|-S|-e|-run] [-O0|-O1|-O2|-O3|-Os] [-j jobs]"
+			" [-march=cpu|-mcpu=cpu] [-mattr=features]\n", cmd, cmd);
 	exit(1);
 }
 
-int main(int argc, char *argv[])
+// Runs the linker (or whatever argv names) and waits for it. Returns nonzero on failure.
+static int run_linker(char **argv)
+{
+	pid_t pid;
+	int status;
+	int e;
+
+	e = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+	if (e != 0) {
+		fprintf(stderr, "%s: Could not run linker \"%s\": %s\n", cmd, argv[0], strerror(e));
+		return 1;
+	}
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s: Linking failed\n", cmd);
+		return 1;
+	}
+	return 0;
+}
+
+// LLVM only warns about a CPU or feature it doesn't recognize, which it does while
+// building the target machine, and for an unknown CPU dies once it generates code. So
+// the target machine is built up front with stderr caught, and any warning is an error.
+// Returns nonzero if there was one.
+static int check_target(compile_ctx *c)
 {
+	FILE *log;
+	char buf[256];
+	size_t n;
+	int saved;
+	int bad;
+
+	if (c->cpu == NULL && c->features == NULL)
+		return 0;
+	log = tmpfile();
+	if (log == NULL)
+		err(1, "Could not create temporary file");
+	fflush(stderr);
+	saved = dup(STDERR_FILENO);
+	dup2(fileno(log), STDERR_FILENO);
+	target_init(c);
+	dup2(saved, STDERR_FILENO);
+	close(saved);
+
+	bad = lseek(fileno(log), 0, SEEK_END) > 0;
+	rewind(log);
+	while ((n = fread(buf, 1, sizeof(buf), log)) > 0)
+		fwrite(buf, 1, n, stderr);
+	fclose(log);
+	if (bad)
+		fprintf(stderr, "%s: Unrecognized target CPU or feature\n", cmd);
+	return bad;
+}
+
+// Links obj into an executable at outfile with the system C compiler driver.
+static int link_executable(char *obj, char *outfile)
+{
+	char *argv[] = {"cc", obj, "-o", outfile, NULL};
+	return run_linker(argv);
+}
+
+// Writes mod out as `output`. Objects and assembly go straight through the target
+// machine; executables are an object in a temporary file handed to the linker.
+static int emit(compile_ctx *c, LLVMModuleRef mod, output_t output, char *outfile)
+{
+	char tmp[] = TMP_OBJ;
+	char *error = NULL;
+	int fd;
+	int ret;
+
+	switch (output) {
+	case OUT_BITCODE:
+		if (LLVMWriteBitcodeToFile(mod, outfile) != 0) {
+			fprintf(stderr, "Could not write bitcode to file!");
+			return 1;
+		}
+		return 0;
+	case OUT_OBJECT:
+	case OUT_ASSEMBLY:
+		if (LLVMTargetMachineEmitToFile(c->tm, mod, outfile,
+					output == OUT_OBJECT ? LLVMObjectFile : LLVMAssemblyFile, &error)) {
+			fprintf(stderr, "%s: Could not write \"%s\": %s\n", cmd, outfile, error);
+			LLVMDisposeMessage(error);
+			return 1;
+		}
+		return 0;
+	case OUT_EXECUTABLE:
+		fd = mkstemp(tmp);
+		if (fd == -1) {
+			perror("Could not create temporary object file");
+			return 1;
+		}
+		close(fd);
+		ret = emit(c, mod, OUT_OBJECT, tmp) || link_executable(tmp, outfile);
+		unlink(tmp);
+		return ret;
+	}
+	return 1;
+}
+
+// With -j, objects and executables are emitted a part at a time on the parts' own threads
+// and put together by the linker: `ld -r` for an object, cc for an executable. The parts
+// see each other's globals (and a whole program's functions) through hidden symbols,
+// which objcopy then makes local, so the object exports what a serial build's does.
+static int emit_parts(compile_ctx *c, ast_decl *program, char *modname, size_t jobs, output_t output, char *outfile)
+{
+	codegen_part *parts = scalloc(jobs, sizeof(*parts));
+	char (*objs)[sizeof(TMP_OBJ)] = smalloc(jobs * sizeof(*objs));
+	char **argv = smalloc((jobs + 5) * sizeof(*argv));
+	size_t argc = 0;
+	size_t made;
+	int ret = 1;
+
+	for (made = 0 ; made < jobs ; ++made) {
+		strcpy(objs[made], TMP_OBJ);
+		int fd = mkstemp(objs[made]);
+		if (fd == -1) {
+			perror("Could not create temporary object file");
+			goto out;
+		}
+		close(fd);
+		parts[made].obj = objs[made];
+	}
+	if (module_codegen_parallel(c, program, modname, parts, jobs) != 0)
+		goto out;
+
+	if (output == OUT_OBJECT) {
+		argv[argc++] = "ld";
+		argv[argc++] = "-r";
+	} else {
+		argv[argc++] = "cc";
+	}
+	for (size_t i = 0 ; i < jobs ; ++i)
+		argv[argc++] = objs[i];
+	argv[argc++] = "-o";
+	argv[argc++] = outfile;
+	argv[argc] = NULL;
+	ret = run_linker(argv);
+	if (ret == 0 && output == OUT_OBJECT) {
+		char *localize[] = {"objcopy", "--localize-hidden", outfile, NULL};
+		ret = run_linker(localize);
+	}
+
+out:
+	for (size_t i = 0 ; i < made ; ++i)
+		unlink(objs[i]);
+	free(argv);
+	free(objs);
+	free(parts);
+	return ret;
+}
+
+// An input file and what it has been turned into so far. The sources and tokens are kept
+// until the end of the compilation.
+typedef struct input {
+	char *name;
 	FILE *f;
-	token_s *head;
+	source *src;
+	token_list *toks;
+} input;
+
+// Scans and parses every input into one program. Several files are one whole program,
+// in the order they were given.
+static ast_decl *parse_inputs(compile_ctx *c, input *inputs, size_t num_inputs)
+{
+	ast_decl *program = NULL;
+	ast_decl *last = NULL;
+
+	c->whole_program = num_inputs > 1;
+	for (size_t i = 0 ; i < num_inputs ; ++i) {
+		c->file = c->whole_program ? inputs[i].name : NULL;
+		inputs[i].src = source_open(inputs[i].f);
+		inputs[i].toks = scan(c, inputs[i].src);
+		if (c->had_error) {
+#ifdef DEBUG
+			eputs("scan error");
+#endif
+			return NULL;
+		}
+		ast_decl *decls = parse_program(c, inputs[i].toks);
+		if (c->had_error) {
+#ifdef DEBUG
+			eputs("parse error");
+#endif
+			return NULL;
+		}
+		if (last == NULL)
+			program = decls;
+		else
+			last->next = decls;
+		for (last = decls ; last->next != NULL ; last = last->next)
+			;
+	}
+	c->file = NULL;
+	return program;
+}
+
+static void close_inputs(input *inputs, size_t num_inputs)
+{
+	for (size_t i = 0 ; i < num_inputs ; ++i) {
+		tok_list_destroy(inputs[i].toks);
+		source_close(inputs[i].src);
+		if (inputs[i].f != NULL)
+			fclose(inputs[i].f);
+	}
+	free(inputs);
+}
+
+int main(int argc, char *argv[])
+{
+	compile_ctx *c;
+	input *inputs;
+	size_t num_inputs = 0;
 	ast_decl *program;
 	char path[4096];
 	char *modname;
 
-	char *infile = NULL;
 	char *outfile = NULL;
 	int option;
+	int had_error;
+	int run = 0;
+	size_t jobs = 1;
+	int result = 0;
+	opt_level_t opt_level = OPT_O0;
+	const char *cpu = NULL;
+	const char *features = NULL;
+	output_t output = OUT_BITCODE;
 
 	cmd = argv[0];
+	inputs = scalloc(argc, sizeof(*inputs));
 
 	// Hey, who knows.
 	assert(CHAR_BIT == 8);
@@ -54,104 +337,147 @@ int main(int argc, char *argv[])
 #endif
 
 	while (optind < argc) {
+		if (strcmp(argv[optind], "-run") == 0) {
+			run = 1;
+			optind++;
+			continue;
+		}
 		// This check if cur arg starts with dash should be unnecessary
 		// but it doesn't work if I remove it?
-		if (argv[optind][0] == '-' && (option = getopt(argc, argv, "o:")) != -1) {
+		if (argv[optind][0] == '-' && (option = getopt(argc, argv, "o:O:cSej:m:")) != -1) {
 			switch (option) {
 			case 'o':
 				outfile = optarg;
 				break;
+			case 'c':
+				output = OUT_OBJECT;
+				break;
+			case 'S':
+				output = OUT_ASSEMBLY;
+				break;
+			case 'e':
+				output = OUT_EXECUTABLE;
+				break;
+			case 'O':
+				opt_level = parse_opt_level(optarg);
+				break;
+			case 'j':
+				jobs = parse_jobs(optarg);
+				break;
+			case 'm':
+				parse_target_option(optarg, &cpu, &features);
+				break;
 			default:
 				usage();
 			}
 		} else {
-			if (infile != NULL) {
-				fprintf(stderr, "%s: Only expecting one positional argument\n", cmd);
-				usage();
-			}
-			infile = argv[optind++];
+			inputs[num_inputs++].name = argv[optind++];
 		}
 	}
 
-	if (infile == NULL) {
+	if (num_inputs == 0) {
 		fprintf(stderr, "%s: Missing input file\n", cmd);
 		usage();
 	}
 
-	f = fopen(infile, "r");
-	if (f == NULL)
-		err(1, "Could not open specified file \"%s\"", infile);
-
-	head = scan(f);
-	if (had_error) {
-#ifdef DEBUG
-		eputs("scan error");
-#endif
-		goto error_noast;
-	}
-	program = parse_program(head);
-	if (had_error) {
-#ifdef DEBUG
-		eputs("parse error");
-#endif
-		goto error_ast;
+	for (size_t i = 0 ; i < num_inputs ; ++i) {
+		inputs[i].f = fopen(inputs[i].name, "r");
+		if (inputs[i].f == NULL)
+			err(1, "Could not open specified file \"%s\"", inputs[i].name);
 	}
 
-	st_init();
-	typecheck_program(program);
-	if (had_error) {
+	c = compile_ctx_init();
+	c->opt_level = opt_level;
+	c->cpu = cpu;
+	c->features = features;
+	program = parse_inputs(c, inputs, num_inputs);
+	if (c->had_error)
+		goto error;
+
+	typecheck_program(c, program);
+	if (c->had_error) {
 #ifdef DEBUG
 		eputs("typecheck error");
 #endif
-		goto error_typecheck;
+		goto error;
 	}
 
-	st_destroy();
-	st_init();
-
-
 	// TODO: check path can fit infile?
-	strcpy(path, infile);
+	// A whole program is named after its first file.
+	strcpy(path, inputs[0].name);
 	modname = basename(path);
 
 	LLVMInitializeNativeTarget();
 	LLVMInitializeNativeAsmPrinter();
+	LLVMInitializeNativeAsmParser();
 	LLVMInitializeAllTargetMCs();
+	if (check_target(c) != 0) {
+		c->had_error = 1;
+#ifdef DEBUG
+		eputs("target error");
+#endif
+		goto error;
+	}
+
+	if (!outfile)
+		outfile = (char *)default_outfile[output];
+	if (jobs > 1 && !run && (output == OUT_OBJECT || output == OUT_EXECUTABLE)) {
+		if (emit_parts(c, program, modname, jobs, output, outfile) != 0)
+			c->had_error = 1;
+		goto done;
+	}
 
-	LLVMContextRef ctxt = LLVMContextCreate();
-	LLVMModuleRef mod = module_codegen(ctxt, program, modname);
+	jit *j = run ? jit_init() : NULL;
+	if (run && j == NULL) {
+		c->had_error = 1;
+		goto error;
+	}
+	LLVMContextRef ctxt = run ? jit_context(j) : LLVMContextCreate();
+	LLVMModuleRef mod;
+	if (jobs > 1) {
+		// The parts are optimized on their threads already.
+		codegen_part *parts = scalloc(jobs, sizeof(*parts));
+		if (module_codegen_parallel(c, program, modname, parts, jobs) != 0)
+			c->had_error = 1;
+		mod = module_link_parts(c, ctxt, program, modname, parts, jobs);
+		free(parts);
+	} else {
+		mod = module_codegen(c, ctxt, program, modname);
+	}
 #ifdef DEBUG
 	LLVMDumpModule(mod);
 #endif
 	char *error = 0;
 	LLVMVerifyModule(mod, LLVMAbortProcessAction, &error);
 	LLVMDisposeMessage(error);
+	if (jobs == 1)
+		module_optimize(c, mod);
 
-	error = 0;
-	if (!outfile)
-		outfile = "a.bc";
-	if (LLVMWriteBitcodeToFile(mod, outfile) != 0) {
-		had_error = 1;
-		fprintf(stderr, "Could not write bitcode to file!");
+	if (run) {
+		// The JIT takes the module, and the context belongs to the session.
+		if (c->had_error)
+			LLVMDisposeModule(mod);
+		else if (jit_run_main(j, mod, &result) != 0)
+			c->had_error = 1;
+		jit_destroy(j);
+	} else {
+		if (!c->had_error && emit(c, mod, output, outfile) != 0)
+			c->had_error = 1;
+		LLVMDisposeModule(mod);
+		LLVMContextDispose(ctxt);
 	}
 
-	st_destroy();
-	ast_free(program);
-	tok_list_destroy(head);
-	LLVMDisposeModule(mod);
-	LLVMContextDispose(ctxt);
+done:
+	had_error = c->had_error;
+	compile_ctx_destroy(c);
+	close_inputs(inputs, num_inputs);
 	LLVMShutdown();
+	return had_error ? had_error : result;
 
-	fclose(f);
-	return had_error;
-
-error_typecheck:
-	st_destroy();
-error_ast:
-	ast_free(program);
-error_noast:
-	tok_list_destroy(head);
-	fclose(f);
+error:
+	had_error = c->had_error;
+	compile_ctx_destroy(c);
+	close_inputs(inputs, num_inputs);
 	LLVMShutdown();
 	return had_error;
 }
@@ -1,30 +1,27 @@
 #include "ast.h"
+#include "compiler.h"
 #include "error.h"
 #include "parse.h"
 #include "print.h"
 #include "token.h"
+#include "types.h"
 
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-token_s *cur_token = NULL;
-token_s *prev_token = NULL;
+#include <string.h>
 
 static inline void next(void)
 {
-	if (cur_token->type == T_EOF)
+	if (cur_ctx->toks->type[cur_ctx->cur_tok] == T_EOF)
 		return;
-	prev_token = cur_token;
-	cur_token = cur_token->next;
+	cur_ctx->prev_tok = cur_ctx->cur_tok;
+	cur_ctx->cur_tok++;
 }
 
 static inline token_t cur_tok_type(void)
 {
-	if (cur_token == NULL) {
-		return T_EOF;
-	}
-	return cur_token->type;
+	return cur_ctx->toks->type[cur_ctx->cur_tok];
 }
 
 static inline int expect(token_t expected)
@@ -34,19 +31,14 @@ static inline int expect(token_t expected)
 
 static size_t cur_tok_line(void)
 {
-	if (cur_token == NULL) {
-		if (prev_token == NULL)
-			return 0;
-		return prev_token->line;
-	}
-	return cur_token->line;
+	return cur_ctx->toks->line[cur_ctx->cur_tok];
 }
 
 static void report_error_cur_tok(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	vreport_error(cur_token->line, cur_token->col, fmt, args);
+	vreport_error(cur_ctx->toks->line[cur_ctx->cur_tok], cur_ctx->toks->col[cur_ctx->cur_tok], fmt, args);
 	va_end(args);
 }
 
@@ -54,7 +46,7 @@ static void report_error_prev_tok(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	vreport_error(prev_token->line, prev_token->col, fmt, args);
+	vreport_error(cur_ctx->toks->line[cur_ctx->prev_tok], cur_ctx->toks->col[cur_ctx->prev_tok], fmt, args);
 	va_end(args);
 }
 
@@ -66,8 +58,6 @@ static void report_error_prev_tok(const char *fmt, ...)
 // Parser is also considered synced at EOF, no matter the target.
 static void sync_to(token_t target, int or_newline)
 {
-	if (cur_token == NULL)
-		return;
 	size_t prevline = cur_tok_line();
 	while (!expect(target)) {
 		if (or_newline && prevline != cur_tok_line())
@@ -86,15 +76,14 @@ static vect *parse_comma_separated_exprs(token_t closer) {
 		next();
 		return ret;
 	}
-	ret = vect_init(4);
+	ret = ast_vect_init(4);
 	do {
 		if (ret->size != 0)
-			next(); // we know cur_token is a comma from while condition.
+			next(); // we know cur_tok is a comma from while condition.
 		cur = parse_expr();
 		if (cur != NULL)
 			vect_append(ret, (void *)cur);
 		else {
-			destroy_expr_vect(ret);
 			return NULL;
 		}
 	} while (expect(T_COMMA));
@@ -102,21 +91,24 @@ static vect *parse_comma_separated_exprs(token_t closer) {
 		report_error_prev_tok("Expression list is missing closing token '", closer);
 		fprint_tok_t(stderr, closer);
 		fprintf(stderr, "'.\n");
-		destroy_expr_vect(ret);
 		ret = NULL;
 	}
 	next();
 	return ret;
 }
 
-ast_decl *parse_program(token_s *head)
+ast_decl *parse_program(compile_ctx *c, token_list *tokens)
 {
-	cur_token = head;
+	cur_ctx = c;
+	cur_ctx->toks = tokens;
+	cur_ctx->cur_tok = 0;
+	cur_ctx->prev_tok = 0;
 	ast_decl *ret = NULL;
 	ast_decl *cur = NULL;
 	ast_decl *tmp = NULL;
 	while (!expect(T_EOF)) {
 		tmp = parse_decl();
+		tmp->file = c->file;
 		if (ret == NULL) {
 			ret = tmp;
 			cur = tmp;
@@ -147,7 +139,7 @@ static vect *parse_arglist(int *had_arglist_error)
 			if (ts == NULL)
 				goto parse_arglist_err;
 			empty = 0;
-			ret = vect_init(2);
+			ret = ast_vect_init(2);
 			vect_append(ret, (void *)ts);
 		} else if (typ == T_COMMA) {
 			next();
@@ -160,11 +152,6 @@ static vect *parse_arglist(int *had_arglist_error)
 		}
 	}
 parse_arglist_err:
-	if (ret != NULL)
-		for (size_t i = 0 ; i < ret->size ; ++i) {
-			ast_typed_symbol_destroy(ret->elements[i]);
-		}
-	vect_destroy(ret);
 	*had_arglist_error = 1;
 	return NULL;
 }
@@ -172,12 +159,11 @@ parse_arglist_err:
 ast_typed_symbol *parse_typed_symbol(void)
 {
 	ast_type *type = NULL;
-	strvec *name = NULL;
+	istr *name = NULL;
 
 	if (!expect(T_IDENTIFIER))
 		goto parse_typsym_err;
-	name = cur_token->text;
-	cur_token->text = NULL;
+	name = cur_ctx->toks->ident[cur_ctx->cur_tok];
 	next();
 
 	if (!expect(T_COLON))
@@ -190,8 +176,6 @@ ast_typed_symbol *parse_typed_symbol(void)
 	return ast_typed_symbol_init(type, name);
 
 parse_typsym_err:
-	type_destroy(type);
-	strvec_destroy(name);
 	return NULL;
 }
 
@@ -210,7 +194,7 @@ static vect *parse_struct_def(void)
 		next();
 		return NULL;
 	}
-	vect *def_vect = vect_init(3);
+	vect *def_vect = ast_vect_init(3);
 	while (!expect(T_RCURLY) && !expect(T_EOF)) {
 		cur = parse_typed_symbol();
 		if (cur != NULL && !expect(T_SEMICO)) {
@@ -259,7 +243,7 @@ ast_decl *parse_decl(void)
 		goto parse_decl_err;
 	}
 
-	typed_symbol->type->modif = vm;
+	typed_symbol->type = type_qualify(typed_symbol->type, vm);
 
 	if (expect(T_SEMICO)) {
 		next();
@@ -278,7 +262,7 @@ ast_decl *parse_decl(void)
 			sync_to(T_EOF, 1);
 			goto parse_decl_err;
 		}
-		typed_symbol->type->arglist = arglist;
+		typed_symbol->type = type_qualify(type_struct_def(arglist), vm);
 	} else if (expect(T_LCURLY)) {
 		stmt = parse_stmt_block();
 		if (stmt == NULL) {
@@ -302,7 +286,7 @@ ast_decl *parse_decl(void)
 	if (!expect(T_SEMICO)) {
 		report_error_prev_tok("Could not parse declaration of variable '%s'. Missing terminating semicolon?\n",
 				typed_symbol->symbol->text);
-		if (cur_token != NULL && prev_token != NULL && cur_token->line == prev_token->line)
+		if (cur_ctx->toks->line[cur_ctx->cur_tok] == cur_ctx->toks->line[cur_ctx->prev_tok])
 			sync_to(T_EOF, 1);
 		goto parse_decl_err;
 	}
@@ -311,9 +295,6 @@ ast_decl *parse_decl(void)
 		goto parse_decl_err;
 	goto parse_decl_ret;
 parse_decl_err:
-	ast_typed_symbol_destroy(typed_symbol);
-	expr_destroy(expr);
-	stmt_destroy(stmt);
 	typed_symbol = NULL;
 	expr = NULL;
 	stmt = NULL;
@@ -445,7 +426,7 @@ asm_parse_done:
 		goto asm_parse_error;
 	next();
 	ast_stmt *ret = stmt_init(S_ASM, NULL, NULL, NULL, NULL, line);
-	ret->asm_obj = smalloc(sizeof(*(ret->asm_obj)));
+	ret->asm_obj = ast_alloc(sizeof(*(ret->asm_obj)));
 	ret->asm_obj->code = code;
 	ret->asm_obj->constraints = constraints;
 	ret->asm_obj->in_operands = in_operands;
@@ -454,21 +435,135 @@ asm_parse_done:
 	return ret;
 
 asm_parse_error:
-	for (size_t i = 0 ; out_operands != NULL &&  i < out_operands->size ; ++i) {
-		expr_destroy(out_operands->elements[i]);
-	}
-	vect_destroy(out_operands);
-	for (size_t i = 0 ; in_operands != NULL &&  i < in_operands->size ; ++i) {
-		expr_destroy(in_operands->elements[i]);
-	}
-	vect_destroy(in_operands);
-	expr_destroy(constraints);
-	expr_destroy(code);
 	report_error_cur_tok("Could not parse inline assembly statement.\n");
 	sync_to(T_SEMICO, 0);
 	return NULL;
 }
 
+// unroll(N) vectorize(N) interleave(N), in any order, between a `for` header and its
+// body. They are only hints, so out of range values are errors rather than clamped.
+static int parse_loop_hints(for_struct *f)
+{
+	while (expect(T_IDENTIFIER)) {
+		const char *name = cur_ctx->toks->ident[cur_ctx->cur_tok]->text;
+		uint32_t *hint;
+		int64_t max;
+		int64_t n;
+
+		if (strcmp(name, "unroll") == 0) {
+			hint = &f->unroll;
+			max = 1024;
+		} else if (strcmp(name, "vectorize") == 0) {
+			hint = &f->vectorize;
+			max = 64;
+		} else if (strcmp(name, "interleave") == 0) {
+			hint = &f->interleave;
+			max = 16;
+		} else {
+			report_error_cur_tok("Unknown loop hint '%s'.\n", name);
+			return 0;
+		}
+		if (*hint != 0) {
+			report_error_cur_tok("Loop hint '%s' given twice.\n", name);
+			return 0;
+		}
+		next();
+		if (!expect(T_LPAREN)) {
+			report_error_cur_tok("Missing left paren after loop hint '%s'.\n", name);
+			return 0;
+		}
+		next();
+		if (!expect(T_INT_LIT)) {
+			report_error_cur_tok("Loop hint '%s' takes an integer.\n", name);
+			return 0;
+		}
+		n = tok_tol(cur_ctx->toks, cur_ctx->cur_tok);
+		if (n < 1 || n > max || (hint != &f->unroll && (n & (n - 1)) != 0)) {
+			report_error_cur_tok("Loop hint '%s' has to be %s from 1 to %ld.\n", name,
+					hint == &f->unroll ? "a number" : "a power of two", (long)max);
+			return 0;
+		}
+		*hint = n;
+		next();
+		if (!expect(T_RPAREN)) {
+			report_error_cur_tok("Missing right paren after loop hint '%s'.\n", name);
+			return 0;
+		}
+		next();
+	}
+	return 1;
+}
+
+// for (init; condition; step) hints { body }
+// init is a declaration, which is only in scope in the loop, or an expression.
+static ast_stmt *parse_for_stmt(void)
+{
+	size_t line = cur_tok_line();
+	ast_stmt *ret = stmt_init(S_FOR, NULL, NULL, NULL, NULL, line);
+	for_struct *f = ast_alloc(sizeof(*f));
+
+	f->init = NULL;
+	f->step = NULL;
+	f->unroll = 0;
+	f->vectorize = 0;
+	f->interleave = 0;
+	ret->for_obj = f;
+
+	next();
+	if (!expect(T_LPAREN)) {
+		report_error_cur_tok("Missing left paren in `for` header.\n");
+		goto for_parse_error;
+	}
+	next();
+	if (expect(T_SEMICO)) {
+		next();
+	} else if (!(expect(T_IF) || expect(T_WHILE) || expect(T_FOR) || expect(T_RETURN)
+				|| expect(T_BREAK) || expect(T_CONTINUE) || expect(T_ASM))) {
+		// Consumes the semicolon.
+		f->init = parse_stmt();
+		if (f->init->kind == S_ERROR)
+			return f->init;
+	} else {
+		report_error_cur_tok("`for` initializer has to be a declaration or an expression.\n");
+		goto for_parse_error;
+	}
+
+	if (!expect(T_SEMICO)) {
+		ret->expr = parse_expr();
+		if (ret->expr == NULL) {
+			report_error_cur_tok("Could not parse `for` condition.\n");
+			goto for_parse_error;
+		}
+		if (!expect(T_SEMICO)) {
+			report_error_cur_tok("Missing semicolon after `for` condition.\n");
+			goto for_parse_error;
+		}
+	}
+	next();
+
+	if (!expect(T_RPAREN)) {
+		f->step = parse_expr();
+		if (f->step == NULL) {
+			report_error_cur_tok("Could not parse `for` step.\n");
+			goto for_parse_error;
+		}
+		if (!expect(T_RPAREN)) {
+			report_error_cur_tok("Missing right paren in `for` header.\n");
+			goto for_parse_error;
+		}
+	}
+	next();
+
+	if (!parse_loop_hints(f))
+		goto for_parse_error;
+	ret->body = parse_stmt_block();
+	return ret;
+
+for_parse_error:
+	sync_to(T_EOF, 1);
+	return stmt_init(S_ERROR, NULL, NULL, NULL, NULL, line);
+}
+
 ast_stmt *parse_stmt(void)
 {
 	stmt_t kind;
@@ -487,7 +582,7 @@ ast_stmt *parse_stmt(void)
 		kind = S_DECL;
 		decl = parse_decl();
 		if (decl->typesym != NULL)
-			decl->typesym->type->modif = VM_CONST;
+			decl->typesym->type = type_qualify(decl->typesym->type, VM_CONST);
 		break;
 	case T_IF:
 		kind = S_IFELSE;
@@ -525,6 +620,8 @@ ast_stmt *parse_stmt(void)
 		}
 		body = parse_stmt_block();
 		break;
+	case T_FOR:
+		return parse_for_stmt();
 	case T_CONTINUE:
 		kind = S_CONTINUE;
 		next();
@@ -581,13 +678,46 @@ ast_stmt *parse_stmt(void)
 	return stmt_init(kind, decl, expr, body, else_body, line);
 stmt_err:
 	sync_to(T_EOF, 1);
-	decl_destroy(decl);
-	expr_destroy(expr);
-	stmt_destroy(body);
-	stmt_destroy(else_body);
 	return stmt_init(S_ERROR, NULL, NULL, NULL, NULL, line);
 }
 
+// vec<elem, lanes>. The element type is checked by the typechecker.
+static ast_type *parse_vector_type(void)
+{
+	ast_type *elem;
+	int64_t lanes;
+
+	next();
+	if (!expect(T_LT)) {
+		report_error_cur_tok("Vector type missing '<'.\n");
+		return NULL;
+	}
+	next();
+	if ((elem = parse_type()) == NULL)
+		return NULL;
+	if (!expect(T_COMMA)) {
+		report_error_cur_tok("Vector type missing comma after the element type.\n");
+		return NULL;
+	}
+	next();
+	if (!expect(T_INT_LIT)) {
+		report_error_cur_tok("Vector type missing its number of lanes.\n");
+		return NULL;
+	}
+	lanes = tok_tol(cur_ctx->toks, cur_ctx->cur_tok);
+	if (lanes < 2 || lanes > 64 || (lanes & (lanes - 1)) != 0) {
+		report_error_cur_tok("Vectors have to have a power of two from 2 to 64 lanes.\n");
+		return NULL;
+	}
+	next();
+	if (!expect(T_GT)) {
+		report_error_cur_tok("Vector type missing '>'.\n");
+		return NULL;
+	}
+	next();
+	return type_vector(elem, lanes);
+}
+
 ast_type *parse_type(void)
 {
 	ast_type *ret = NULL;
@@ -639,14 +769,16 @@ ast_type *parse_type(void)
 		} else if (expect(T_IDENTIFIER)) {
 			// struct instantiation
 			// let p: struct point;
-			ret->name = cur_token->text;
-			cur_token->text = NULL;
+			ret = type_init(Y_STRUCT, cur_ctx->toks->ident[cur_ctx->cur_tok]);
 			next();
 		} else {
 			report_error_cur_tok("Invalid token in struct type specifier\n");
 			next();
 		}
 		break;
+	case T_VEC:
+		ret = parse_vector_type();
+		break;
 	case T_LPAREN:
 		next();
 		arglist = parse_arglist(&had_arglist_err);
@@ -665,9 +797,7 @@ ast_type *parse_type(void)
 			report_error_cur_tok("Missing/invalid return type in function declaration.\n");
 			sync_to(T_ASSIGN, 0);
 		}
-		ret = type_init(Y_FUNCTION, NULL);
-		ret->subtype = subtype;
-		ret->arglist = arglist;
+		ret = type_function(subtype, arglist);
 		break;
 	default:
 		report_error_cur_tok("Invalid type.\n");
@@ -677,198 +807,92 @@ ast_type *parse_type(void)
 	while (cur_tok_type() == T_STAR || cur_tok_type() == T_AT) {
 		// TODO: more generic value_modifier_t handling? Maybe more value modifiers in future?
 		value_modifier_t vm = cur_tok_type() == T_AT ? VM_CONST : VM_DEFAULT;
-		subtype = ret;
-		ret = type_init(vm == VM_CONST ? Y_CONSTPTR : Y_POINTER, NULL);
-		ret->subtype = subtype;
-		ret->subtype->modif = vm;
+		ret = type_pointer(vm == VM_CONST ? Y_CONSTPTR : Y_POINTER, type_qualify(ret, vm));
 		next();
 	}
 	return ret;
 }
 
-// Shoutouts to https://www.engr.mun.ca/~theo/Misc/exp_parsing.htm#classic
-// for info on parsing binary expressions with recursive descent parsers :)
-ast_expr *parse_expr(void)
+// Binary operator precedence, loosest first. This is the grammar of the old one-function-
+// per-level descent chain, quirks included: ^ binds looser than |, and the right hand side
+// of ==/!= is parsed at +/- level, so `a == b < c` stops after `a == b`.
+enum {
+	PREC_NONE,
+	PREC_ASSIGN,
+	PREC_OR,
+	PREC_AND,
+	PREC_BW_XOR,
+	PREC_BW_OR,
+	PREC_BW_AND,
+	PREC_EQUALITY,
+	PREC_INEQUALITY,
+	PREC_SHIFT,
+	PREC_ADDSUB,
+	PREC_MULDIV,
+	PREC_UNARY,
+};
+
+struct binop {
+	expr_t kind;
+	int prec;
+	int rhs_prec; // loosest operator allowed in the right hand side
+};
+
+// Anything not listed has PREC_NONE and ends a binary expression.
+static const struct binop binops[T_NUM_TOKENS] = {
+	[T_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_ADD_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_SUB_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_MUL_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_DIV_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_MOD_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_BW_AND_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_BW_OR_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_XOR_ASSIGN] = {E_ASSIGN, PREC_ASSIGN, PREC_OR},
+	[T_OR] = {E_LOG_OR, PREC_OR, PREC_AND},
+	[T_AND] = {E_LOG_AND, PREC_AND, PREC_BW_XOR},
+	[T_XOR] = {E_BW_XOR, PREC_BW_XOR, PREC_BW_OR},
+	[T_BW_OR] = {E_BW_OR, PREC_BW_OR, PREC_BW_AND},
+	[T_AMPERSAND] = {E_BW_AND, PREC_BW_AND, PREC_EQUALITY},
+	[T_EQ] = {E_EQUALITY, PREC_EQUALITY, PREC_ADDSUB},
+	[T_NEQ] = {E_EQUALITY, PREC_EQUALITY, PREC_ADDSUB},
+	[T_LT] = {E_INEQUALITY, PREC_INEQUALITY, PREC_SHIFT},
+	[T_LTE] = {E_INEQUALITY, PREC_INEQUALITY, PREC_SHIFT},
+	[T_GT] = {E_INEQUALITY, PREC_INEQUALITY, PREC_SHIFT},
+	[T_GTE] = {E_INEQUALITY, PREC_INEQUALITY, PREC_SHIFT},
+	[T_LSHIFT] = {E_SHIFT, PREC_SHIFT, PREC_ADDSUB},
+	[T_RSHIFT] = {E_SHIFT, PREC_SHIFT, PREC_ADDSUB},
+	[T_PLUS] = {E_ADDSUB, PREC_ADDSUB, PREC_MULDIV},
+	[T_MINUS] = {E_ADDSUB, PREC_ADDSUB, PREC_MULDIV},
+	[T_STAR] = {E_MULDIV, PREC_MULDIV, PREC_UNARY},
+	[T_FSLASH] = {E_MULDIV, PREC_MULDIV, PREC_UNARY},
+	[T_PERCENT] = {E_MULDIV, PREC_MULDIV, PREC_UNARY},
+};
+
+// Precedence climbing, see https://www.engr.mun.ca/~theo/Misc/exp_parsing.htm#climbing
+// Every operator is left associative. max_prec keeps an operator that the right hand side
+// refused (see the ==/!= quirk above) from being picked up by the loop afterwards.
+static ast_expr *parse_expr_binary(int min_prec)
 {
-	return parse_expr_assign();
-}
-
-ast_expr *parse_expr_assign(void)
-{
-	ast_expr *this = parse_expr_or();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_ASSIGN || typ == T_ADD_ASSIGN || typ == T_SUB_ASSIGN ||
-			typ == T_MUL_ASSIGN || typ == T_DIV_ASSIGN || typ == T_MOD_ASSIGN ||
-			typ == T_BW_AND_ASSIGN || typ == T_BW_OR_ASSIGN || typ == T_XOR_ASSIGN) {
-		op = typ;
-		next();
-		that = parse_expr_or();
-		this = expr_init(E_ASSIGN, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_or(void)
-{
-	ast_expr *this = parse_expr_and();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_OR) {
-		op = typ;
-		next();
-		that = parse_expr_and();
-		this = expr_init(E_LOG_OR, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_and(void)
-{
-	ast_expr *this = parse_expr_bw_xor();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_AND) {
-		op = typ;
-		next();
-		that = parse_expr_bw_xor();
-		this = expr_init(E_LOG_AND, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_bw_xor(void)
-{
-	ast_expr *this = parse_expr_bw_or();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_XOR) {
-		op = typ;
-		next();
-		that = parse_expr_bw_or();
-		this = expr_init(E_BW_XOR, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_bw_or(void)
-{
-	ast_expr *this = parse_expr_bw_and();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_BW_OR) {
-		op = typ;
-		next();
-		that = parse_expr_bw_and();
-		this = expr_init(E_BW_OR, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_bw_and(void)
-{
-	ast_expr *this = parse_expr_equality();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_AMPERSAND) {
-		op = typ;
-		next();
-		that = parse_expr_equality();
-		this = expr_init(E_BW_AND, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_equality(void)
-{
-	ast_expr *this = parse_expr_inequality();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_NEQ || typ == T_EQ) {
-		op = typ;
-		next();
-		that = parse_expr_addsub();
-		this = expr_init(E_EQUALITY, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_inequality(void)
-{
-	ast_expr *this = parse_expr_shift();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_LT || typ == T_LTE || typ == T_GT || typ == T_GTE) {
-		op = typ;
-		next();
-		that = parse_expr_shift();
-		this = expr_init(E_INEQUALITY, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_shift(void)
-{
-	ast_expr *this = parse_expr_addsub();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_LSHIFT || typ == T_RSHIFT) {
-		op = typ;
-		next();
-		that = parse_expr_addsub();
-		this = expr_init(E_SHIFT, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
-}
-
-ast_expr *parse_expr_addsub(void)
-{
-	ast_expr *this = parse_expr_muldiv();
+	ast_expr *this = parse_expr_pre_unary();
 	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_MINUS || typ == T_PLUS) {
-		op = typ;
+	int max_prec = PREC_UNARY;
+	token_t op = cur_tok_type();
+	const struct binop *b = &binops[op];
+	while (b->prec >= min_prec && b->prec <= max_prec) {
 		next();
-		that = parse_expr_muldiv();
-		this = expr_init(E_ADDSUB, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
+		that = parse_expr_binary(b->rhs_prec);
+		this = expr_init(b->kind, this, that, op, NULL, 0, NULL);
+		max_prec = b->prec;
+		op = cur_tok_type();
+		b = &binops[op];
 	}
 	return this;
 }
 
-ast_expr *parse_expr_muldiv(void)
+ast_expr *parse_expr(void)
 {
-	ast_expr *this = parse_expr_pre_unary();
-	ast_expr *that;
-	token_t typ = cur_tok_type();
-	token_t op;
-	while (typ == T_STAR || typ == T_FSLASH || typ == T_PERCENT) {
-		op = typ;
-		next();
-		that = parse_expr_pre_unary();
-		this = expr_init(E_MULDIV, this, that, op, NULL, 0, NULL);
-		typ = cur_tok_type();
-	}
-	return this;
+	return parse_expr_binary(PREC_ASSIGN);
 }
 
 ast_expr *parse_expr_pre_unary(void)
@@ -913,7 +937,6 @@ ast_expr *parse_expr_post_unary(void)
 			e = parse_expr();
 			if (!expect(T_RBRACKET)) {
 				report_error_cur_tok("Missing closing bracket.\n");
-				expr_destroy(e);
 				return NULL;
 			}
 			next();
@@ -953,21 +976,17 @@ static ast_expr *parse_cast(void)
 
 	if (!expect(T_COMMA)) {
 		report_error_cur_tok("Cast expression missing comma\n");
-		expr_destroy(e);
 		return NULL;
 	}
 
 	next();
 
 	if ((t = parse_type()) == NULL) {
-		expr_destroy(e);
 		report_error_cur_tok("Could not parse type in cast expression\n");
 		return NULL;
 	}
 
 	if (!expect(T_RPAREN)) {
-		expr_destroy(e);
-		type_destroy(t);
 		report_error_cur_tok("Cast expression missing closing paren\n");
 		return NULL;
 	}
@@ -975,7 +994,6 @@ static ast_expr *parse_cast(void)
 
 	ast_expr *ret = expr_init(E_CAST, e, NULL, 0, NULL, 0, NULL);
 	ret->type = t;
-	ret->owns_type = true;
 	return ret;
 }
 
@@ -983,7 +1001,7 @@ static ast_expr *parse_cast(void)
 ast_expr *parse_expr_unit(void)
 {
 	token_t typ = cur_tok_type();
-	token_s *cur = cur_token;
+	size_t cur = cur_ctx->cur_tok;
 	strvec *txt;
 	ast_expr *ex = NULL;
 	ast_expr *ret;
@@ -996,7 +1014,6 @@ ast_expr *parse_expr_unit(void)
 			// TODO leave error handling to fns like parse_stmt and parse_decl.
 			// Just bubble the error up by returning zero.
 			report_error_cur_tok("Expression is missing a closing paren.\n");
-			expr_destroy(ex);
 			return NULL;
 		}
 		next();
@@ -1009,34 +1026,41 @@ ast_expr *parse_expr_unit(void)
 	case T_INT_LIT:
 		next();
 		int64_t n;
-		n = strvec_tol(cur->text);
+		n = tok_tol(cur_ctx->toks, cur);
 		if (errno != 0) {
 			report_error_prev_tok("Could not parse int literal\n");
 		}
 		ex = expr_init(E_INT_LIT, NULL, NULL, 0, NULL, n, NULL);
 		ex->type = type_init(smallest_fit(n), NULL);
-		ex->owns_type = true;
 		return ex;
 	case T_STR_LIT:
-		txt = cur->text;
-		cur->text = NULL;
+		txt = tok_text(cur_ctx->toks, cur);
 		next();
 		return expr_init(E_STR_LIT, NULL, NULL, 0, NULL, 0, txt);
 	case T_IDENTIFIER:
-		txt = cur->text;
-		cur->text = NULL;
 		next();
 		if (expect(T_LPAREN)) {
-			ex = expr_init(E_FNCALL, NULL, NULL, 0, txt, 0, NULL);
+			ex = expr_init(E_FNCALL, NULL, NULL, 0, cur_ctx->toks->ident[cur], 0, NULL);
 			ex->sub_exprs = parse_comma_separated_exprs(T_RPAREN);
 			return ex;
 		} else {
-			ex = expr_init(E_IDENTIFIER, NULL, NULL, 0, txt, 0, NULL);
+			ex = expr_init(E_IDENTIFIER, NULL, NULL, 0, cur_ctx->toks->ident[cur], 0, NULL);
 			ex->is_lvalue = 1;
 			return ex;
 		}
 	case T_CAST:
 		return parse_cast();
+	case T_SHUFFLE:
+	case T_LOADU:
+	case T_STOREU:
+		next();
+		if (!expect(T_LPAREN)) {
+			report_error_cur_tok("Vector builtin missing opening paren.\n");
+			return NULL;
+		}
+		ex = expr_init(E_VECTOR_OP, NULL, NULL, typ, NULL, 0, NULL);
+		ex->sub_exprs = parse_comma_separated_exprs(T_RPAREN);
+		return ex;
 	case T_TRUE:
 		next();
 		return expr_init(E_TRUE_LIT, NULL, NULL, 0, NULL, 0, NULL);
@@ -1044,8 +1068,7 @@ ast_expr *parse_expr_unit(void)
 		next();
 		return expr_init(E_FALSE_LIT, NULL, NULL, 0, NULL, 0, NULL);
 	case T_CHAR_LIT:
-		txt = cur->text;
-		cur->text = NULL;
+		txt = tok_text(cur_ctx->toks, cur);
 		next();
 		return expr_init(E_CHAR_LIT, NULL, NULL, 0, NULL, 0, txt);
 	default:
@@ -1057,6 +1080,5 @@ ast_expr *parse_expr_unit(void)
 ast_expr *build_cast(ast_expr *ex, type_t kind) {
 	ast_expr *ret = expr_init(E_CAST, ex, NULL, 0, NULL, 0, NULL);
 	ret->type = type_init(kind, NULL);
-	ret->owns_type = true;
 	return ret;
 }
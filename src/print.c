@@ -118,10 +118,16 @@ void fexpr_print(FILE *f, ast_expr *expr)
 		fprintf(f, "\"");
 		break;
 	case E_IDENTIFIER:
-		fstrvec_print(f, expr->name);
+		fputs(expr->name->text, f);
 		break;
 	case E_FNCALL:
-		fstrvec_print(f, expr->name);
+		fputs(expr->name->text, f);
+		fprintf(f, "(");
+		fprint_sub_exprs(f, expr);
+		fprintf(f, ")");
+		break;
+	case E_VECTOR_OP:
+		fprint_tok_t(f, expr->op);
 		fprintf(f, "(");
 		fprint_sub_exprs(f, expr);
 		fprintf(f, ")");
@@ -141,7 +147,7 @@ void ftyped_sym_print(FILE *f, ast_typed_symbol *typesym)
 {
 	if (!typesym)
 		return;
-	fstrvec_print(f, typesym->symbol);
+	fputs(typesym->symbol->text, f);
 	fprintf(f, ": ");
 	ftype_print(f, typesym->type);
 }
@@ -195,11 +201,16 @@ void ftype_print(FILE *f, ast_type *type)
 		ftype_print(f, type->subtype);
 		fprintf(f, "@");
 		break;
+	case Y_VECTOR:
+		fprintf(f, "vec<");
+		ftype_print(f, type->subtype);
+		fprintf(f, ", %u>", type->lanes);
+		break;
 	case Y_STRUCT:
 		fprintf(f, "struct");
 		if (type->name != NULL) {
 			fprintf(f, " ");
-			fstrvec_print(f, type->name);
+			fputs(type->name->text, f);
 		}
 		break;
 	default:
@@ -291,6 +302,25 @@ void fstmt_print(FILE *f, ast_stmt *stmt)
 		fprintf(f, ") ");
 		fstmt_print(f, stmt->body);
 		break;
+	case S_FOR:
+		fprintf(f, "for (");
+		if (stmt->for_obj->init)
+			fstmt_print(f, stmt->for_obj->init);
+		else
+			fprintf(f, ";");
+		fprintf(f, " ");
+		fexpr_print(f, stmt->expr);
+		fprintf(f, "; ");
+		fexpr_print(f, stmt->for_obj->step);
+		fprintf(f, ") ");
+		if (stmt->for_obj->unroll)
+			fprintf(f, "unroll(%u) ", stmt->for_obj->unroll);
+		if (stmt->for_obj->vectorize)
+			fprintf(f, "vectorize(%u) ", stmt->for_obj->vectorize);
+		if (stmt->for_obj->interleave)
+			fprintf(f, "interleave(%u) ", stmt->for_obj->interleave);
+		fstmt_print(f, stmt->body);
+		break;
 	default:
 		fprintf(f, "Somehow reached error/unkown statement printing case?\n");
 	}
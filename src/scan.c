@@ -1,385 +1,507 @@
 #include "error.h"
 #include "scan.h"
+#include "scan_simd.h"
 
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-static token_s *check_if_keyword(strvec *word, size_t line, size_t col)
+typedef struct scanner {
+	const char *buf;
+	size_t size;
+	size_t pos;
+	size_t line;
+	size_t col;
+	token_list *toks;
+	const scan_kernels *skip;
+} scanner;
+
+// next_char/unget_char stand in for fgetc/ungetc. Just like ungetc, only ungetting the
+// character that was just read is supported.
+static inline int next_char(scanner *s)
 {
-	// this approach feels slow but oh well.
-	token_s *ret = NULL;
-	if (strvec_equals_str(word, "i32"))
-		ret = tok_init_nl(T_I32, line, col, NULL);
-	else if (strvec_equals_str(word, "let"))
-		ret = tok_init_nl(T_LET, line, col, NULL);
-	else if (strvec_equals_str(word, "if"))
-		ret = tok_init_nl(T_IF, line, col, NULL);
-	else if (strvec_equals_str(word, "true"))
-		ret = tok_init_nl(T_TRUE, line, col, NULL);
-	else if (strvec_equals_str(word, "false"))
-		ret = tok_init_nl(T_FALSE, line, col, NULL);
-	else if (strvec_equals_str(word, "i64"))
-		ret = tok_init_nl(T_I64, line, col, NULL);
-	else if (strvec_equals_str(word, "u32"))
-		ret = tok_init_nl(T_U32, line, col, NULL);
-	else if (strvec_equals_str(word, "u64"))
-		ret = tok_init_nl(T_U64, line, col, NULL);
-	else if (strvec_equals_str(word, "usize"))
-		ret = tok_init_nl(T_USIZE, line, col, NULL);
-	else if (strvec_equals_str(word, "const"))
-		ret = tok_init_nl(T_CONST, line, col, NULL);
-	else if (strvec_equals_str(word, "break"))
-		ret = tok_init_nl(T_BREAK, line, col, NULL);
-	else if (strvec_equals_str(word, "continue"))
-		ret = tok_init_nl(T_CONTINUE, line, col, NULL);
-	else if (strvec_equals_str(word, "else"))
-		ret = tok_init_nl(T_ELSE, line, col, NULL);
-	else if (strvec_equals_str(word, "void"))
-		ret = tok_init_nl(T_VOID, line, col, NULL);
-	else if (strvec_equals_str(word, "char"))
-		ret = tok_init_nl(T_CHAR, line, col, NULL);
-	else if (strvec_equals_str(word, "return"))
-		ret = tok_init_nl(T_RETURN, line, col, NULL);
-	else if (strvec_equals_str(word, "while"))
-		ret = tok_init_nl(T_WHILE, line, col, NULL);
-	else if (strvec_equals_str(word, "bool"))
-		ret = tok_init_nl(T_BOOL, line, col, NULL);
-	else if (strvec_equals_str(word, "struct"))
-		ret = tok_init_nl(T_STRUCT, line, col, NULL);
-	else if (strvec_equals_str(word, "asm"))
-		ret = tok_init_nl(T_ASM, line, col, NULL);
-	else if (strvec_equals_str(word, "sizeof"))
-		ret = tok_init_nl(T_SIZEOF, line, col, NULL);
-	else if (strvec_equals_str(word, "cast"))
-		ret = tok_init_nl(T_CAST, line, col, NULL);
-	else if (strvec_equals_str(word, "null"))
-		ret = tok_init_nl(T_NULL, line, col, NULL);
-	else if (strvec_equals_str(word, "proto"))
-		ret = tok_init_nl(T_PROTO, line, col, NULL);
-	if (ret != NULL)
-		strvec_destroy(word);
-	else
-		ret = tok_init_nl(T_IDENTIFIER, line, col, word);
-	return ret;
+	if (s->pos >= s->size)
+		return EOF;
+	return (unsigned char)s->buf[s->pos++];
 }
 
-static token_s *scan_word(FILE *f, size_t *line, size_t *col)
+static inline void unget_char(scanner *s, int c)
 {
-	int c;
-	strvec *word = strvec_init(5);
-	size_t old_col = *col;
-	while (1) {
-		c = fgetc(f);
-		if (!(isalpha(c) || c == '_' || isdigit(c)))
-			break;
-		++(*col);
-		strvec_append(word, c);
+	if (c != EOF)
+		s->pos--;
+}
+
+source *source_open(FILE *f)
+{
+	source *ret = smalloc(sizeof(*ret));
+	struct stat st;
+	size_t cap;
+	size_t n;
+	int fd = fileno(f);
+
+	ret->text = NULL;
+	ret->size = 0;
+	ret->mapped = 0;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m != MAP_FAILED) {
+			ret->text = m;
+			ret->size = st.st_size;
+			ret->mapped = 1;
+			return ret;
+		}
 	}
-	ungetc(c, f);
-	return check_if_keyword(word, *line, old_col);
+
+	// Not mmap-able (pipe, empty file, ...): fall back to reading it all in at once.
+	cap = 4096;
+	ret->text = smalloc(cap);
+	while ((n = fread(ret->text + ret->size, 1, cap - ret->size, f)) > 0) {
+		ret->size += n;
+		if (ret->size == cap) {
+			cap *= 2;
+			ret->text = srealloc(ret->text, cap);
+		}
+	}
+	return ret;
+}
+
+void source_close(source *src)
+{
+	if (src == NULL)
+		return;
+	if (src->mapped)
+		munmap(src->text, src->size);
+	else
+		free(src->text);
+	free(src);
+}
+
+static inline token_t add_tok(scanner *s, token_t type, size_t line, size_t col, size_t offset, size_t len,
+		istr *ident)
+{
+	tok_list_append(s->toks, type, line, col, offset, len, ident);
+	return type;
 }
-static token_s *scan_number(int negative, FILE *f, size_t *line, size_t *col)
+
+// Dispatches on length, then on first character, so a word is compared against at most
+// two keywords instead of all of them. That's as good as a perfect hash for this few
+// keywords, and unlike one it needs no generator to rerun when they change. Keep this
+// in sync with the keyword tokens in token.h!
+static token_t check_if_keyword(const char *word, size_t len)
 {
-	int c;
-	strvec *num = strvec_init(5);
-	size_t old_col = *col;
-	if (negative)
-		strvec_append(num, '-');
-	while (1) {
-		c = fgetc(f);
-		// TODO: Support float literals
-		if (!(isdigit(c)))
+	switch (len) {
+	case 2:
+		if (!memcmp(word, "if", 2))
+			return T_IF;
+		break;
+	case 3:
+		switch (word[0]) {
+		case 'a':
+			if (!memcmp(word, "asm", 3))
+				return T_ASM;
+			break;
+		case 'f':
+			if (!memcmp(word, "for", 3))
+				return T_FOR;
+			break;
+		case 'i':
+			if (!memcmp(word, "i32", 3))
+				return T_I32;
+			if (!memcmp(word, "i64", 3))
+				return T_I64;
+			break;
+		case 'l':
+			if (!memcmp(word, "let", 3))
+				return T_LET;
+			break;
+		case 'u':
+			if (!memcmp(word, "u32", 3))
+				return T_U32;
+			if (!memcmp(word, "u64", 3))
+				return T_U64;
+			break;
+		case 'v':
+			if (!memcmp(word, "vec", 3))
+				return T_VEC;
+			break;
+		}
+		break;
+	case 4:
+		switch (word[0]) {
+		case 'b':
+			if (!memcmp(word, "bool", 4))
+				return T_BOOL;
 			break;
-		++(*col);
-		strvec_append(num, c);
+		case 'c':
+			if (!memcmp(word, "char", 4))
+				return T_CHAR;
+			if (!memcmp(word, "cast", 4))
+				return T_CAST;
+			break;
+		case 'e':
+			if (!memcmp(word, "else", 4))
+				return T_ELSE;
+			break;
+		case 'n':
+			if (!memcmp(word, "null", 4))
+				return T_NULL;
+			break;
+		case 't':
+			if (!memcmp(word, "true", 4))
+				return T_TRUE;
+			break;
+		case 'v':
+			if (!memcmp(word, "void", 4))
+				return T_VOID;
+			break;
+		}
+		break;
+	case 5:
+		switch (word[0]) {
+		case 'b':
+			if (!memcmp(word, "break", 5))
+				return T_BREAK;
+			break;
+		case 'c':
+			if (!memcmp(word, "const", 5))
+				return T_CONST;
+			break;
+		case 'f':
+			if (!memcmp(word, "false", 5))
+				return T_FALSE;
+			break;
+		case 'l':
+			if (!memcmp(word, "loadu", 5))
+				return T_LOADU;
+			break;
+		case 'p':
+			if (!memcmp(word, "proto", 5))
+				return T_PROTO;
+			break;
+		case 'u':
+			if (!memcmp(word, "usize", 5))
+				return T_USIZE;
+			break;
+		case 'w':
+			if (!memcmp(word, "while", 5))
+				return T_WHILE;
+			break;
+		}
+		break;
+	case 6:
+		switch (word[0]) {
+		case 'r':
+			if (!memcmp(word, "return", 6))
+				return T_RETURN;
+			break;
+		case 's':
+			if (!memcmp(word, "struct", 6))
+				return T_STRUCT;
+			if (!memcmp(word, "sizeof", 6))
+				return T_SIZEOF;
+			if (!memcmp(word, "storeu", 6))
+				return T_STOREU;
+			break;
+		}
+		break;
+	case 7:
+		if (!memcmp(word, "shuffle", 7))
+			return T_SHUFFLE;
+		break;
+	case 8:
+		if (!memcmp(word, "continue", 8))
+			return T_CONTINUE;
+		break;
 	}
-	ungetc(c, f);
-	return tok_init_nl(T_INT_LIT, *line, old_col, num);
+	return T_IDENTIFIER;
+}
+
+static token_t scan_word(scanner *s)
+{
+	token_t type;
+	size_t len;
+	size_t start = s->pos;
+	size_t old_col = s->col;
+	s->pos = s->skip->ident(s->buf, s->pos, s->size);
+	len = s->pos - start;
+	s->col += len;
+	type = check_if_keyword(s->buf + start, len);
+	return add_tok(s, type, s->line, old_col, start, len,
+			type == T_IDENTIFIER ? intern(s->buf + start, len) : NULL);
+}
+
+static token_t scan_number(int negative, scanner *s)
+{
+	size_t digits_start = s->pos;
+	// The minus sign was already consumed, but it is part of the literal's text.
+	size_t start = s->pos - (negative ? 1 : 0);
+	size_t old_col = s->col;
+	// TODO: Support float literals
+	s->pos = s->skip->digits(s->buf, s->pos, s->size);
+	s->col += s->pos - digits_start;
+	return add_tok(s, T_INT_LIT, s->line, old_col, start, s->pos - start, NULL);
 }
 
 // Assumes you come into this function having just scanned a backslash
 // quote char for single or double quotes. this works for strings and chars.
-static char try_escape_sequence(FILE *f, size_t *line, size_t *col, char quote_char, int *failed) {
-	char c;
-	(*col)++;
-	c = fgetc(f);
-	*failed = 0;
-	if (c == 'n')
-		return '\n';
-	else if (c == '\\')
-		return '\\';
+// Only validates the escape: decoding is done by tok_text when the literal is needed.
+static void try_escape_sequence(scanner *s, char quote_char, int *failed) {
+	int c;
+	(s->col)++;
+	c = next_char(s);
+	if (c == 'n' || c == '\\' || c == '0')
+		return;
 	else if (c == '\'' && quote_char == '\'')
-		return '\'';
+		return;
 	else if (c == '"' && quote_char == '"')
-		return '"';
-	else if (c == '0')
-		return '\0';
+		return;
 
 	if (c == '\n')
-		ungetc(c, f);
+		unget_char(s, c);
 
-	report_error(*line, *col - 1, "Unrecognized escape character\n");
+	report_error(s->line, s->col - 1, "Unrecognized escape character\n");
 	*failed = 1;
-	return 'E';
 }
 
-static token_s *scan_char_literal(FILE *f, size_t *line, size_t *col)
+static token_t scan_char_literal(scanner *s)
 {
 	int c;
 	int c2;
 	int fail_flag = 0;
-	strvec *character = NULL;
-	size_t old_col = *col;
-	(*col)++;
-	c = fgetc(f);
-	if (c == '\n') {
-		ungetc(c, f);
-		report_error(*line, old_col, "Bad char literal. Missing close quote?\n");
-		return tok_init_nl(T_ERROR, *line, old_col, NULL);
+	size_t start = s->pos;
+	size_t old_col = s->col;
+	(s->col)++;
+	c = next_char(s);
+	if (c == '\n' || c == EOF) {
+		unget_char(s, c);
+		report_error(s->line, old_col, "Bad char literal. Missing close quote?\n");
+		return add_tok(s, T_ERROR, s->line, old_col, 0, 0, NULL);
 	} else if (c == '\\') {
-		c = try_escape_sequence(f, line, col, '\'', &fail_flag);
+		try_escape_sequence(s, '\'', &fail_flag);
 	} else if (c == '\'') {
-		(*col)++;
-		report_error(*line, old_col, "Empty char literal.\n");
-		return tok_init_nl(T_ERROR, *line, old_col, NULL);
+		(s->col)++;
+		report_error(s->line, old_col, "Empty char literal.\n");
+		return add_tok(s, T_ERROR, s->line, old_col, 0, 0, NULL);
 	}
-	(*col)++;
-	c2 = fgetc(f);
+	(s->col)++;
+	c2 = next_char(s);
 	if (c2 != '\'') {
-		ungetc(c2, f);
-		report_error(*line, old_col, "Bad char literal. Missing close quote?\n");
-		return tok_init_nl(T_ERROR, *line, old_col, NULL);
+		unget_char(s, c2);
+		report_error(s->line, old_col, "Bad char literal. Missing close quote?\n");
+		return add_tok(s, T_ERROR, s->line, old_col, 0, 0, NULL);
 	}
-	(*col)++;
+	(s->col)++;
 	// Don't quit at fail flag first time around: also warn if missing close quote.
 	if (fail_flag)
-		return tok_init_nl(T_ERROR, *line, old_col, NULL);
-	character = strvec_init(1);
-	strvec_append(character, c);
-	return tok_init_nl(T_CHAR_LIT, *line, old_col, character);
+		return add_tok(s, T_ERROR, s->line, old_col, 0, 0, NULL);
+	return add_tok(s, T_CHAR_LIT, s->line, old_col, start, s->pos - 1 - start, NULL);
 }
 
-static token_s *scan_string_literal(FILE *f, size_t *line, size_t *col)
+static token_t scan_string_literal(scanner *s)
 {
 	int c;
 	int fail_flag = 0;
-	strvec *str = strvec_init(5);
-	size_t old_col = *col;
-	(*col)++;
-	while ((c = fgetc(f)) != '"') {
-		(*col)++;
-		if (c == '\n') {
-			ungetc(c, f);
-			(*col)--;
-			strvec_destroy(str);
-			report_error(*line, old_col, "Unterminated string literal.\n");
-			return tok_init_nl(T_ERROR, *line, old_col, NULL);
+	size_t start = s->pos;
+	size_t old_col = s->col;
+	(s->col)++;
+	while ((c = next_char(s)) != '"') {
+		(s->col)++;
+		if (c == '\n' || c == EOF) {
+			unget_char(s, c);
+			(s->col)--;
+			report_error(s->line, old_col, "Unterminated string literal.\n");
+			return add_tok(s, T_ERROR, s->line, old_col, 0, 0, NULL);
 		}
 		if (c == '\\')
-			strvec_append(str, try_escape_sequence(f, line, col, '"', &fail_flag));
-		else
-			strvec_append(str, c);
-	}
-	(*col)++;
-	if (fail_flag) {
-		strvec_destroy(str);
-		return tok_init_nl(T_ERROR, *line, old_col, NULL);
+			try_escape_sequence(s, '"', &fail_flag);
 	}
-	return tok_init_nl(T_STR_LIT, *line, old_col, str);
+	(s->col)++;
+	if (fail_flag)
+		return add_tok(s, T_ERROR, s->line, old_col, 0, 0, NULL);
+	return add_tok(s, T_STR_LIT, s->line, old_col, start, s->pos - 1 - start, NULL);
 }
 
-token_s *scan_next_token(FILE *f, size_t *line, size_t *col)
+static token_t scan_next_token(scanner *s)
 {
 	int c;
 	size_t temp_col;
-	while (isspace(c = fgetc(f))) {
-		if (c == '\n') {
-			*col = 0;
-			++(*line);
-		}
-		++(*col);
-	}
-	temp_col = *col;
+scan_next_token_start:
+	s->pos = s->skip->space(s->buf, s->pos, s->size, &s->line, &s->col);
+	c = next_char(s);
+	temp_col = s->col;
 
 	if (isalpha(c) || c == '_') {
-		ungetc(c, f);
-		return scan_word(f, line, col);
+		unget_char(s, c);
+		return scan_word(s);
 	} else if (isdigit(c)) {
-		ungetc(c, f);
-		return scan_number(0, f, line, col);
+		unget_char(s, c);
+		return scan_number(0, s);
 	}
 	switch (c) {
 	case EOF:
-		return tok_init_nl(T_EOF, *line, *col, NULL);
+		return add_tok(s, T_EOF, s->line, s->col, 0, 0, NULL);
 	case '\'':
-		return scan_char_literal(f, line, col);
+		return scan_char_literal(s);
 	case '"':
-		return scan_string_literal(f, line, col);
+		return scan_string_literal(s);
 	case '+':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_ADD_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_ADD_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_PLUS, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_PLUS, s->line, (s->col)++, 0, 0, NULL);
 	case '-':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_SUB_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_SUB_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		} else if (c == '>') {
-			*col += 2;
-			return tok_init_nl(T_ARROW, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_ARROW, s->line, temp_col, 0, 0, NULL);
 		} else if (isdigit(c)) {
-			*col += 1;
-			ungetc(c, f);
-			return scan_number(1, f, line, col);
+			s->col += 1;
+			unget_char(s, c);
+			return scan_number(1, s);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_MINUS, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_MINUS, s->line, (s->col)++, 0, 0, NULL);
 	case '*':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_MUL_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_MUL_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_STAR, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_STAR, s->line, (s->col)++, 0, 0, NULL);
 	case '/':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_DIV_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_DIV_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		} else if (c == '/') {
-			while ((c = fgetc(f)) != '\n' && c != EOF);
-			ungetc(c, f);
-			return scan_next_token(f, line, col);
+			s->pos = s->skip->line(s->buf, s->pos, s->size);
+			goto scan_next_token_start;
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_FSLASH, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_FSLASH, s->line, (s->col)++, 0, 0, NULL);
 	case '%':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_MOD_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_MOD_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_PERCENT, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_PERCENT, s->line, (s->col)++, 0, 0, NULL);
 	case '<':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_LTE, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_LTE, s->line, temp_col, 0, 0, NULL);
 		} else if (c == '<') {
-			*col += 2;
-			return tok_init_nl(T_LSHIFT, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_LSHIFT, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_LT, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_LT, s->line, (s->col)++, 0, 0, NULL);
 	case '>':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_GTE, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_GTE, s->line, temp_col, 0, 0, NULL);
 		} else if (c == '>') {
-			*col += 2;
-			return tok_init_nl(T_RSHIFT, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_RSHIFT, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_GT, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_GT, s->line, (s->col)++, 0, 0, NULL);
 	case '=':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_EQ, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_EQ, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_ASSIGN, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_ASSIGN, s->line, (s->col)++, 0, 0, NULL);
 	case '!':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_NEQ, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_NEQ, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_NOT, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_NOT, s->line, (s->col)++, 0, 0, NULL);
 	case '^':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_XOR_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_XOR_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_XOR, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_XOR, s->line, (s->col)++, 0, 0, NULL);
 	case '&':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '&') {
-			*col += 2;
-			return tok_init_nl(T_AND, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_AND, s->line, temp_col, 0, 0, NULL);
 		} else if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_BW_AND_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_BW_AND_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_AMPERSAND, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_AMPERSAND, s->line, (s->col)++, 0, 0, NULL);
 	case '|':
-		c = fgetc(f);
+		c = next_char(s);
 		if (c == '|') {
-			*col += 2;
-			return tok_init_nl(T_OR, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_OR, s->line, temp_col, 0, 0, NULL);
 		} else if (c == '=') {
-			*col += 2;
-			return tok_init_nl(T_BW_OR_ASSIGN, *line, temp_col, NULL);
+			s->col += 2;
+			return add_tok(s, T_BW_OR_ASSIGN, s->line, temp_col, 0, 0, NULL);
 		}
-		ungetc(c, f);
-		return tok_init_nl(T_BW_OR, *line, (*col)++, NULL);
+		unget_char(s, c);
+		return add_tok(s, T_BW_OR, s->line, (s->col)++, 0, 0, NULL);
 	case '@':
-		return tok_init_nl(T_AT, *line, (*col)++, NULL);
+		return add_tok(s, T_AT, s->line, (s->col)++, 0, 0, NULL);
 	case '.': // TODO: support floating pt literals like .5
-		return tok_init_nl(T_PERIOD, *line, (*col)++, NULL);
+		return add_tok(s, T_PERIOD, s->line, (s->col)++, 0, 0, NULL);
 	case '~':
-		return tok_init_nl(T_BW_NOT, *line, (*col)++, NULL);
+		return add_tok(s, T_BW_NOT, s->line, (s->col)++, 0, 0, NULL);
 	case ':':
-		return tok_init_nl(T_COLON, *line, (*col)++, NULL);
+		return add_tok(s, T_COLON, s->line, (s->col)++, 0, 0, NULL);
 	case ';':
-		return tok_init_nl(T_SEMICO, *line, (*col)++, NULL);
+		return add_tok(s, T_SEMICO, s->line, (s->col)++, 0, 0, NULL);
 	case ',':
-		return tok_init_nl(T_COMMA, *line, (*col)++, NULL);
+		return add_tok(s, T_COMMA, s->line, (s->col)++, 0, 0, NULL);
 	case '(':
-		return tok_init_nl(T_LPAREN, *line, (*col)++, NULL);
+		return add_tok(s, T_LPAREN, s->line, (s->col)++, 0, 0, NULL);
 	case ')':
-		return tok_init_nl(T_RPAREN, *line, (*col)++, NULL);
+		return add_tok(s, T_RPAREN, s->line, (s->col)++, 0, 0, NULL);
 	case '{':
-		return tok_init_nl(T_LCURLY, *line, (*col)++, NULL);
+		return add_tok(s, T_LCURLY, s->line, (s->col)++, 0, 0, NULL);
 	case '}':
-		return tok_init_nl(T_RCURLY, *line, (*col)++, NULL);
+		return add_tok(s, T_RCURLY, s->line, (s->col)++, 0, 0, NULL);
 	case '[':
-		return tok_init_nl(T_LBRACKET, *line, (*col)++, NULL);
+		return add_tok(s, T_LBRACKET, s->line, (s->col)++, 0, 0, NULL);
 	case ']':
-		return tok_init_nl(T_RBRACKET, *line, (*col)++, NULL);
+		return add_tok(s, T_RBRACKET, s->line, (s->col)++, 0, 0, NULL);
 	default:
-		report_error(*line, *col, "Unrecognized token '%c'.\n", '#');
-		return tok_init_nl(T_ERROR, *line, (*col)++, NULL);
+		report_error(s->line, s->col, "Unrecognized token '%c'.\n", '#');
+		return add_tok(s, T_ERROR, s->line, (s->col)++, 0, 0, NULL);
 	}
 }
 
-token_s *scan(FILE *f)
+token_list *scan(compile_ctx *c, source *src)
 {
-	token_s *head = NULL;
-	token_s *cur = NULL;
-	token_s *prev = NULL;
-	size_t line = 1;
-	size_t col = 1;
-	while (1) {
-		prev = cur;
-		cur = scan_next_token(f, &line, &col);
-		if (!head)
-			head = cur;
-		else {
-			prev->next = cur;
-		}
-		if (cur->type == T_EOF)
-			return head;
-	}
+	// Rough guess of one token per four bytes of source to avoid most regrowing.
+	token_list *toks;
+	cur_ctx = c;
+	toks = tok_list_init(src->text, src->size / 4 + 16);
+	scanner s = {src->text, src->size, 0, 1, 1, toks, scan_kernels_select()};
+	while (scan_next_token(&s) != T_EOF);
+	return toks;
 }
@@ -1,11 +1,23 @@
 #ifndef SCAN_H
 #define SCAN_H
 
+#include "compiler.h"
 #include "token.h"
 
 #include <stddef.h>
 #include <stdio.h>
 
-token_s *scan(FILE *f);
-token_s *scan_next_token(FILE *f, size_t *line, size_t *col);
+// The whole input file, either mmap'd or read into memory in one go.
+// Tokens point straight into `text`, so a source must outlive its tokens.
+// `text` is NOT guaranteed to be NUL-terminated!
+typedef struct source {
+	char *text;
+	size_t size;
+	int mapped;
+} source;
+
+source *source_open(FILE *f);
+void source_close(source *src);
+
+token_list *scan(compile_ctx *c, source *src);
 #endif
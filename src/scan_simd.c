@@ -0,0 +1,206 @@
+#include "scan_simd.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static inline int is_space(unsigned char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int is_ident(unsigned char c)
+{
+	return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static size_t space_scalar(const char *buf, size_t pos, size_t size, size_t *line, size_t *col)
+{
+	unsigned char c;
+	for (; pos < size && is_space(c = buf[pos]) ; ++pos) {
+		if (c == '\n') {
+			*col = 0;
+			++(*line);
+		}
+		++(*col);
+	}
+	return pos;
+}
+
+static size_t ident_scalar(const char *buf, size_t pos, size_t size)
+{
+	while (pos < size && is_ident(buf[pos]))
+		++pos;
+	return pos;
+}
+
+static size_t digits_scalar(const char *buf, size_t pos, size_t size)
+{
+	while (pos < size && buf[pos] >= '0' && buf[pos] <= '9')
+		++pos;
+	return pos;
+}
+
+static size_t line_scalar(const char *buf, size_t pos, size_t size)
+{
+	while (pos < size && buf[pos] != '\n')
+		++pos;
+	return pos;
+}
+
+const scan_kernels scan_kernels_scalar = {
+	"scalar", space_scalar, ident_scalar, digits_scalar, line_scalar
+};
+
+#ifdef SCAN_X86
+// Line/column bookkeeping for a whitespace run of n bytes whose newlines are the set
+// bits of nl. Matches space_scalar: a newline resets the column to 1.
+static inline void space_advance(unsigned n, unsigned nl, size_t *line, size_t *col)
+{
+	if (nl) {
+		*line += __builtin_popcount(nl);
+		*col = n - (31 - __builtin_clz(nl));
+	} else {
+		*col += n;
+	}
+}
+
+// Bytes are compared as signed, so anything >= 0x80 falls outside every range below.
+#define IN_RANGE128(v, lo, hi) _mm_and_si128(_mm_cmpgt_epi8((v), _mm_set1_epi8((lo) - 1)), \
+		_mm_cmpgt_epi8(_mm_set1_epi8((hi) + 1), (v)))
+
+static size_t space_sse2(const char *buf, size_t pos, size_t size, size_t *line, size_t *col)
+{
+	while (pos + 16 <= size) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + pos));
+		__m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), IN_RANGE128(v, '\t', '\r'));
+		unsigned stop = ~_mm_movemask_epi8(ws) & 0xFFFF;
+		unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		unsigned n = stop ? __builtin_ctz(stop) : 16;
+		space_advance(n, nl & ((1u << n) - 1), line, col);
+		pos += n;
+		if (stop)
+			return pos;
+	}
+	return space_scalar(buf, pos, size, line, col);
+}
+
+static size_t ident_sse2(const char *buf, size_t pos, size_t size)
+{
+	while (pos + 16 <= size) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + pos));
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i id = _mm_or_si128(IN_RANGE128(lower, 'a', 'z'),
+				_mm_or_si128(IN_RANGE128(v, '0', '9'), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+		unsigned stop = ~_mm_movemask_epi8(id) & 0xFFFF;
+		if (stop)
+			return pos + __builtin_ctz(stop);
+		pos += 16;
+	}
+	return ident_scalar(buf, pos, size);
+}
+
+static size_t digits_sse2(const char *buf, size_t pos, size_t size)
+{
+	while (pos + 16 <= size) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + pos));
+		unsigned stop = ~_mm_movemask_epi8(IN_RANGE128(v, '0', '9')) & 0xFFFF;
+		if (stop)
+			return pos + __builtin_ctz(stop);
+		pos += 16;
+	}
+	return digits_scalar(buf, pos, size);
+}
+
+static size_t line_sse2(const char *buf, size_t pos, size_t size)
+{
+	while (pos + 16 <= size) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + pos));
+		unsigned stop = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		if (stop)
+			return pos + __builtin_ctz(stop);
+		pos += 16;
+	}
+	return line_scalar(buf, pos, size);
+}
+
+static const scan_kernels scan_kernels_sse2 = {
+	"sse2", space_sse2, ident_sse2, digits_sse2, line_sse2
+};
+
+#define AVX2 __attribute__((target("avx2")))
+#define IN_RANGE256(v, lo, hi) _mm256_and_si256(_mm256_cmpgt_epi8((v), _mm256_set1_epi8((lo) - 1)), \
+		_mm256_cmpgt_epi8(_mm256_set1_epi8((hi) + 1), (v)))
+
+// The AVX2 kernels handle 32-byte blocks and leave the last <32 bytes to SSE2.
+AVX2 static size_t space_avx2(const char *buf, size_t pos, size_t size, size_t *line, size_t *col)
+{
+	while (pos + 32 <= size) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + pos));
+		__m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+				IN_RANGE256(v, '\t', '\r'));
+		unsigned stop = ~(unsigned)_mm256_movemask_epi8(ws);
+		unsigned nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		unsigned n = stop ? __builtin_ctz(stop) : 32;
+		space_advance(n, n == 32 ? nl : nl & ((1u << n) - 1), line, col);
+		pos += n;
+		if (stop)
+			return pos;
+	}
+	return space_sse2(buf, pos, size, line, col);
+}
+
+AVX2 static size_t ident_avx2(const char *buf, size_t pos, size_t size)
+{
+	while (pos + 32 <= size) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + pos));
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i id = _mm256_or_si256(IN_RANGE256(lower, 'a', 'z'),
+				_mm256_or_si256(IN_RANGE256(v, '0', '9'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+		unsigned stop = ~(unsigned)_mm256_movemask_epi8(id);
+		if (stop)
+			return pos + __builtin_ctz(stop);
+		pos += 32;
+	}
+	return ident_sse2(buf, pos, size);
+}
+
+AVX2 static size_t digits_avx2(const char *buf, size_t pos, size_t size)
+{
+	while (pos + 32 <= size) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + pos));
+		unsigned stop = ~(unsigned)_mm256_movemask_epi8(IN_RANGE256(v, '0', '9'));
+		if (stop)
+			return pos + __builtin_ctz(stop);
+		pos += 32;
+	}
+	return digits_sse2(buf, pos, size);
+}
+
+AVX2 static size_t line_avx2(const char *buf, size_t pos, size_t size)
+{
+	while (pos + 32 <= size) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + pos));
+		unsigned stop = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		if (stop)
+			return pos + __builtin_ctz(stop);
+		pos += 32;
+	}
+	return line_sse2(buf, pos, size);
+}
+
+static const scan_kernels scan_kernels_avx2 = {
+	"avx2", space_avx2, ident_avx2, digits_avx2, line_avx2
+};
+#endif
+
+const scan_kernels *scan_kernels_select(void)
+{
+#ifdef SCAN_X86
+	// SSE2 is part of x86-64, only AVX2 needs checking.
+	return __builtin_cpu_supports("avx2") ? &scan_kernels_avx2 : &scan_kernels_sse2;
+#else
+	return &scan_kernels_scalar;
+#endif
+}
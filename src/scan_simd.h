@@ -0,0 +1,27 @@
+#ifndef SCAN_SIMD_H
+#define SCAN_SIMD_H
+
+#include <stddef.h>
+
+// Run-skipping kernels for the scanner. Each one starts at buf[pos] and returns the
+// offset of the first byte at or after pos (and before size) that ends the run.
+// The vector versions never read past buf[size - 1], so mmap'd sources are fine.
+typedef struct scan_kernels {
+	const char *name;
+	// Whitespace as in isspace(). Advances *line and *col over the skipped bytes the
+	// same way the scanner does one character at a time.
+	size_t (*space)(const char *buf, size_t pos, size_t size, size_t *line, size_t *col);
+	// [A-Za-z0-9_]
+	size_t (*ident)(const char *buf, size_t pos, size_t size);
+	// [0-9]
+	size_t (*digits)(const char *buf, size_t pos, size_t size);
+	// Anything but '\n', i.e. the rest of a // comment.
+	size_t (*line)(const char *buf, size_t pos, size_t size);
+} scan_kernels;
+
+extern const scan_kernels scan_kernels_scalar;
+
+// Picks the widest kernels the running CPU supports.
+const scan_kernels *scan_kernels_select(void);
+
+#endif
@@ -3,17 +3,15 @@
 
 #include <stddef.h>
 
-struct node {
-	void *data;
-	struct node *next;
-};
-
+// A stack backed by a growable array, so any position can be reached in O(1).
 typedef struct stack {
 	size_t size;
-	struct node *top;
+	size_t capacity;
+	void **items;
 } stack;
 
 stack *stack_init(void);
+void stack_destroy(stack *stk);
 void stack_push(stack *stk, void *item);
 void *stack_pop(stack *stk);
 void *stack_item_from_base(stack *stk, size_t position);
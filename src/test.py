@@ -29,24 +29,61 @@ def try_remove(file_paths):
 
 
 class Test:
-    def __init__(self, name, program, comp_error, ret):
+    def __init__(self, name, program, comp_error, ret, flags, ir_contains, separate):
         self.name = name
         self.program = program
         self.comp_error = comp_error
         self.ret = ret
+        self.flags = flags
+        self.ir_contains = ir_contains
+        self.separate = separate
+
+    # Compiles every file into an object of its own and links the objects together.
+    def run_separate(self, compiler_bin_path, sources, tf_print):
+        objs = [f'{s}.o' for s in sources]
+        bn = f'{sources[0]}-bin'
+        files = sources + objs + [bn]
+        for src, obj in zip(sources, objs):
+            res = subprocess.run([compiler_bin_path, src] + self.flags + ['-c', '-o', obj], capture_output=True, text=True)
+            if res.returncode != 0:
+                tf_print(f'Got unexpected error while compiling {src}:')
+                for line in res.stderr.split('\n'):
+                    tf_print(f'\t{line}')
+                try_remove(files)
+                return 0
+
+        link_res = subprocess.run(['clang'] + objs + ['-o', bn], capture_output=True, text=True)
+        if link_res.returncode != 0:
+            tf_print('Unexpected failure while linking:')
+            for line in link_res.stderr.split('\n'):
+                tf_print(f'\t{line}')
+            try_remove(files)
+            return 0
+        bn_res = subprocess.run(f'./{bn}', capture_output=True, text=True)
+        try_remove(files)
+        if self.ret != bn_res.returncode:
+            tf_print('Return codes did not match.')
+            return 0
+        return 1
 
     def run(self, compiler_bin_path):
-        tf = open('tmpfile', 'w')
-        bc = f'{tf.name}.bc'
-        obj = f'{tf.name}.o'
-        bn = f'{tf.name}-bin'
-        files = [tf.name, bc, obj, bn]
+        # A '// NEXT_FILE' line starts another input file of the same program, or with
+        # the 'separate' directive, another object to link it with.
+        sources = []
+        for i, part in enumerate(self.program.split('// NEXT_FILE\n')):
+            with open(f'tmpfile{i + 1 if i else ""}', 'w') as tf:
+                tf.write(part)
+            sources.append(tf.name)
+        bc = f'{sources[0]}.bc'
+        obj = f'{sources[0]}.o'
+        bn = f'{sources[0]}-bin'
+        files = sources + [bc, obj, bn]
         def tf_print(msg):
             print(f'{self.name}: {msg}')
+        if self.separate:
+            return self.run_separate(compiler_bin_path, sources, tf_print)
 
-        tf.write(self.program)
-        tf.close()
-        cmd = [compiler_bin_path, tf.name, '-o', bc]
+        cmd = [compiler_bin_path] + sources + self.flags + ['-o', bc]
         res = subprocess.run(cmd, capture_output=True, text=True)
         if not res.stdout.startswith('Debug mode enabled'):
             try_remove(files)
@@ -63,6 +100,15 @@ class Test:
             try_remove(files)
             return 0
 
+        if self.ir_contains:
+            dis = subprocess.run(['llvm-dis', bc, '-o', '-'], capture_output=True, text=True)
+            missing = [s for s in self.ir_contains if s not in dis.stdout]
+            if dis.returncode != 0 or missing:
+                for s in missing:
+                    tf_print(f'IR does not contain {s}')
+                try_remove(files)
+                return 0
+
         llc = ['llc', '--filetype=obj', bc, '-o', obj]
         llc_res = subprocess.run(llc, capture_output=True, text=True)
         if llc_res.stderr != "":
@@ -101,6 +147,9 @@ class Test:
 def test_from_testfile(open_file):
     err = None
     ret = None
+    flags = []
+    ir_contains = []
+    separate = False
     program = ''
     hd = False # 'hd' = 'header done'
     for line in open_file:
@@ -121,11 +170,19 @@ def test_from_testfile(open_file):
                         ret = int(splt[2])
                     except ValueError:
                         raise Exception(f'in testfile {open_file.name}: could not parse supplied arg of ret directive "{splt[1]}" as integer')
+                case 'flags':
+                    flags += splt[2:]
+                case 'ir_contains':
+                    if len(splt) < 3:
+                        raise Exception(f'in testfile {open_file.name}: ir_contains directive requires the text to look for.')
+                    ir_contains.append(line.strip().split(None, 2)[2])
+                case 'separate':
+                    separate = True
                 case 'END_HEADER':
                     hd = True
                 case _:
                     raise Exception(f'in testfile {open_file.name}: bad directive "{splt[0]}" in test {open_file.name}')
-    return Test(open_file.name, program, err, ret)
+    return Test(open_file.name, program, err, ret, flags, ir_contains, separate)
 
 
 total = 0
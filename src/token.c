@@ -1,57 +1,109 @@
 #include "token.h"
 #include "util.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-/**
- *	Like tok_init, but with no provided link to next token.
- */
-token_s *tok_init_nl(token_t type, size_t line, size_t col, strvec *text)
+token_list *tok_list_init(const char *src, size_t capacity)
 {
-	return tok_init(type, line, col, NULL, text);
+	token_list *ret = smalloc(sizeof(*ret));
+	ret->size = 0;
+	ret->capacity = capacity;
+	ret->type = smalloc(capacity * sizeof(*ret->type));
+	ret->line = smalloc(capacity * sizeof(*ret->line));
+	ret->col = smalloc(capacity * sizeof(*ret->col));
+	ret->offset = smalloc(capacity * sizeof(*ret->offset));
+	ret->len = smalloc(capacity * sizeof(*ret->len));
+	ret->ident = smalloc(capacity * sizeof(*ret->ident));
+	ret->src = src;
+	return ret;
 }
 
-token_s *tok_init(token_t type, size_t line, size_t col, token_s *next, strvec *text)
+void tok_list_append(token_list *toks, token_t type, size_t line, size_t col, size_t offset, size_t len,
+			istr *ident)
 {
-	token_s *ret = malloc(sizeof(*ret));
-	ret->type = type;
-	ret->line = line;
-	ret->col = col;
-	ret->next = next;
-	ret->text = text;
-	return ret;
+	size_t i = toks->size;
+	if (toks->capacity <= toks->size) {
+		toks->capacity *= 2;
+		toks->type = srealloc(toks->type, toks->capacity * sizeof(*toks->type));
+		toks->line = srealloc(toks->line, toks->capacity * sizeof(*toks->line));
+		toks->col = srealloc(toks->col, toks->capacity * sizeof(*toks->col));
+		toks->offset = srealloc(toks->offset, toks->capacity * sizeof(*toks->offset));
+		toks->len = srealloc(toks->len, toks->capacity * sizeof(*toks->len));
+		toks->ident = srealloc(toks->ident, toks->capacity * sizeof(*toks->ident));
+	}
+	toks->type[i] = type;
+	toks->line[i] = line;
+	toks->col[i] = col;
+	toks->offset[i] = offset;
+	toks->len[i] = len;
+	toks->ident[i] = ident;
+	toks->size++;
 }
-void tok_list_destroy(token_s *head)
+
+void tok_list_destroy(token_list *toks)
 {
-	token_s *tmp;
-	while (head) {
-		tmp = head->next;
-		tok_destroy(head);
-		head = tmp;
-	}
+	if (toks == NULL)
+		return;
+	free(toks->type);
+	free(toks->line);
+	free(toks->col);
+	free(toks->offset);
+	free(toks->len);
+	free(toks->ident);
+	free(toks);
 }
 
-void tok_destroy(token_s *tok)
+/**
+ *	Materialize an owned copy of token i's text. String and char literal
+ *	escapes were already validated by the scanner, so they are just decoded here.
+ */
+strvec *tok_text(token_list *toks, size_t i)
 {
-	strvec_destroy(tok->text);
-	free(tok);
+	strvec *ret;
+	const char *start = toks->src + toks->offset[i];
+	size_t len = toks->len[i];
+	if (toks->type[i] != T_STR_LIT && toks->type[i] != T_CHAR_LIT)
+		return strvec_init_slice(start, len);
+	ret = strvec_init(len);
+	for (size_t j = 0 ; j < len ; ++j) {
+		char c = start[j];
+		if (c == '\\') {
+			c = start[++j];
+			if (c == 'n')
+				c = '\n';
+			else if (c == '0')
+				c = '\0';
+		}
+		strvec_append(ret, c);
+	}
+	return ret;
 }
 
-void tok_setnext(token_s *cur, token_s *next)
+// Check errno at calling code!
+long tok_tol(token_list *toks, size_t i)
 {
-	cur->next = next;
+	char buf[32];
+	if (toks->len[i] >= sizeof(buf)) {
+		errno = ERANGE;
+		return 0;
+	}
+	memcpy(buf, toks->src + toks->offset[i], toks->len[i]);
+	buf[toks->len[i]] = '\0';
+	errno = 0;
+	return strtol(buf, 0, 10);
 }
 
-void fprint_tok(FILE *f, token_s *t)
+void fprint_tok(FILE *f, token_list *toks, size_t i)
 {
-	if (t == NULL)
+	if (toks == NULL || i >= toks->size)
 		return;
-	fprint_tok_t(f, t->type);
+	fprint_tok_t(f, toks->type[i]);
 	fprintf(f, " ");
-	if (t->text)
-		fstrvec_print(f, t->text);
-	fprintf(f, "\tLine %lu Col %lu (type %d)\n", t->line, t->col, t->type);
+	fprintf(f, "%.*s", (int)toks->len[i], toks->src + toks->offset[i]);
+	fprintf(f, "\tLine %lu Col %lu (type %d)\n", toks->line[i], toks->col[i], toks->type[i]);
 }
 
 void fprint_tok_t(FILE *f, token_t t)
@@ -232,6 +284,18 @@ void fprint_tok_t(FILE *f, token_t t)
 	case T_RBRACKET:
 		fprintf(f, "]");
 		break;
+	case T_VEC:
+		fprintf(f, "vec");
+		break;
+	case T_SHUFFLE:
+		fprintf(f, "shuffle");
+		break;
+	case T_LOADU:
+		fprintf(f, "loadu");
+		break;
+	case T_STOREU:
+		fprintf(f, "storeu");
+		break;
 	default:
 		fprintf(f, "%d", t);
 		break;
@@ -1,6 +1,7 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include "intern.h"
 #include "util.h"
 
 #include <stddef.h>
@@ -35,6 +36,10 @@ typedef enum {
 	T_CAST,
 	T_NULL,
 	T_PROTO,
+	T_VEC,
+	T_SHUFFLE,
+	T_LOADU,
+	T_STOREU,
 
 	T_DPLUS,
 	T_DMINUS,
@@ -93,22 +98,32 @@ typedef enum {
 	T_INT_LIT,
 	T_STR_LIT,
 	T_CHAR_LIT,
+
+	T_NUM_TOKENS // Not a token! Keep this last.
 } token_t;
 
-typedef struct token_s {
-	token_t type;
-	size_t line;
-	size_t col;
-	struct token_s *next;
-	strvec *text;
-} token_s;
-
-token_s *tok_init(token_t type, size_t line, size_t col, token_s *next,
-			strvec *text);
-token_s *tok_init_nl(token_t type, size_t line, size_t col, strvec *text);
-void tok_list_destroy(token_s *head);
-void tok_destroy(token_s *tok);
-void tok_setnext(token_s *cur, token_s *next);
-void fprint_tok(FILE *f, token_s *token);
+// Tokens are stored struct-of-arrays style: token i is made up of type[i], line[i], etc.
+// Its text is the slice [offset[i], offset[i] + len[i]) of `src`, which is not
+// NUL-terminated! Use tok_text for an owned copy. Identifiers are interned while
+// scanning, ident[i] holds the interned text (NULL for anything else).
+typedef struct token_list {
+	size_t size;
+	size_t capacity;
+	token_t *type;
+	size_t *line;
+	size_t *col;
+	size_t *offset;
+	size_t *len;
+	istr **ident;
+	const char *src;
+} token_list;
+
+token_list *tok_list_init(const char *src, size_t capacity);
+void tok_list_append(token_list *toks, token_t type, size_t line, size_t col, size_t offset, size_t len,
+			istr *ident);
+void tok_list_destroy(token_list *toks);
+strvec *tok_text(token_list *toks, size_t i);
+long tok_tol(token_list *toks, size_t i);
+void fprint_tok(FILE *f, token_list *toks, size_t i);
 void fprint_tok_t(FILE *f, token_t t);
 #endif
@@ -1,22 +1,22 @@
 #include "error.h"
+#include "ht.h"
 #include "parse.h"
 #include "print.h"
 #include "symbol_table.h"
 #include "typecheck.h"
+#include "types.h"
 #include "util.h"
 
 #include <stdarg.h>
 #include <stdio.h>
 
 
-static int in_loop = 0;
-static int cur_line = 0;
 
 static void report_error_cur_line(const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	vreport_error_line(cur_line, fmt, args);
+	vreport_error_line(cur_ctx->cur_line, fmt, args);
 	va_end(args);
 }
 
@@ -54,13 +54,28 @@ static void l_r_mismatch(const char *msg, ast_expr *l, ast_expr *r) {
 	fprintf(stderr, ")]\n");
 }
 
-void typecheck_program(ast_decl *program)
+void typecheck_program(compile_ctx *c, ast_decl *program)
 {
 	ast_decl *cur = program;
+	cur_ctx = c;
+	c->num_globals = 0;
+	st_init();
 	while (cur != NULL) {
+		c->file = cur->file;
 		typecheck_decl(cur, 1);
 		cur = cur->next;
 	}
+	c->file = NULL;
+	st_destroy();
+}
+
+// Binds a symbol and hands out its slot: the next one of the module for globals, the
+// next one of the function being checked for everything else.
+static void bind_symbol(ast_typed_symbol *ts, int global)
+{
+	ts->is_global = global;
+	ts->slot = global ? cur_ctx->num_globals++ : cur_ctx->num_locals++;
+	scope_bind_ts(ts);
 }
 
 static void scope_bind_args(ast_decl *decl)
@@ -75,12 +90,12 @@ static void scope_bind_args(ast_decl *decl)
 	if (arglist == NULL)
 		return;
 	for (i = 0 ; i < arglist->size ; ++i)
-		scope_bind_ts(arglist_get(arglist, i));
+		bind_symbol(arglist_get(arglist, i), 0);
 }
 
 static void typecheck_return(ast_stmt *stmt) {
 	ast_type *typ;
-	cur_line = stmt->line;
+	cur_ctx->cur_line = stmt->line;
 
 	if (stmt->next != NULL) {
 		report_error_cur_line("Return statements must be at the end of statement blocks.\n");
@@ -170,12 +185,17 @@ static void typecheck_fnbody(ast_decl *decl)
 		report_error_cur_line("Must provide a function body to non-prototype declaration of '%s'\n", decl_name(decl));
 		return;
 	}
+	size_t old_num_locals = cur_ctx->num_locals;
+	cur_ctx->num_locals = 0;
 	scope_enter();
 	scope_bind_return_type(decl->typesym->type->subtype);
+	// Arguments come first, so an argument's slot is its position.
 	scope_bind_args(decl);
 	append_retvoid_if_needed(decl);
 	typecheck_stmt(decl->body->body, 1);
 	scope_exit();
+	decl->num_locals = cur_ctx->num_locals;
+	cur_ctx->num_locals = old_num_locals;
 }
 
 
@@ -209,6 +229,16 @@ static int is_int_type(ast_type *t)
 	}
 }
 
+static int is_vector_type(ast_type *t)
+{
+	return t != NULL && t->kind == Y_VECTOR;
+}
+
+static int valid_lanes(int64_t lanes)
+{
+	return lanes >= 2 && lanes <= 64 && (lanes & (lanes - 1)) == 0;
+}
+
 // Returns zero if lhs and rhs are the same bit width!
 // TODO: think of a better name.
 static int right_can_cast_implicitly(ast_type *left, ast_type *right)
@@ -260,6 +290,7 @@ static void typecheck_global_decl(ast_decl *decl)
 		return;
 	case Y_FUNCTION:
 	case Y_STRUCT:
+	case Y_VECTOR:
 	case Y_VOID:
 		report_error_cur_line("Could not declare a declaration of type ");
 		e_type_print(decl->typesym->type);
@@ -296,6 +327,9 @@ static int valid_type_for_decl(ast_type *tp, int pointing) {
 	case Y_CONSTPTR:
 		return valid_type_for_decl(tp->subtype, 1);
 
+	case Y_VECTOR:
+		return is_int_type(tp->subtype);
+
 	case Y_VOID:
 		return pointing;
 	case Y_FUNCTION:
@@ -312,6 +346,20 @@ static int valid_type_for_decl(ast_type *tp, int pointing) {
 	return 0;
 }
 
+// Files compiled into one program include the same headers, so there a prototype of a
+// function that's already declared, or a struct definition identical to the one before
+// it, is fine. It refers to the first one.
+static int is_repeated_decl(ast_typed_symbol *first, ast_decl *decl)
+{
+	ast_type *t = decl->typesym->type;
+
+	if (t->kind == Y_FUNCTION && t->modif == VM_PROTO)
+		return first->type->kind == Y_FUNCTION && type_equals(first->type, t, 1);
+	if (t->kind == Y_STRUCT && t->name == NULL)
+		return first->type == t;
+	return 0;
+}
+
 void typecheck_decl(ast_decl *decl, int at_global_level)
 {
 	ast_typed_symbol *ts = NULL;
@@ -320,8 +368,13 @@ void typecheck_decl(ast_decl *decl, int at_global_level)
 		report_error_cur_line("Typechecking empty decl!?!?!\n");
 		return;
 	}
-	cur_line = decl->line;
+	cur_ctx->cur_line = decl->line;
 	if ((ts = scope_lookup_current(decl->typesym->symbol))) {
+		if (at_global_level && cur_ctx->whole_program && is_repeated_decl(ts, decl)) {
+			decl->typesym->is_global = ts->is_global;
+			decl->typesym->slot = ts->slot;
+			return;
+		}
 		if (ts->type->modif != VM_PROTO) {
 			report_error_cur_line("Duplicate declaration of symbol '%s'\n", decl_name(decl));
 			return;
@@ -336,7 +389,9 @@ void typecheck_decl(ast_decl *decl, int at_global_level)
 			return;
 		}
 		// TODO: might want to put this somewhere else? This still works though.
-		ts->type->modif = VM_PROTO_DEFINED;
+		ts->type = type_qualify(ts->type, VM_PROTO_DEFINED);
+		decl->typesym->is_global = ts->is_global;
+		decl->typesym->slot = ts->slot;
 	}
 	if (decl->typesym->type->modif == VM_PROTO) {
 		if (decl->typesym->type->kind != Y_FUNCTION) {
@@ -347,7 +402,7 @@ void typecheck_decl(ast_decl *decl, int at_global_level)
 			report_error_cur_line("Function prototype '%s' must not be assigned a body/value.\n", decl_name(decl));
 			return;
 		}
-		scope_bind_ts(decl->typesym);
+		bind_symbol(decl->typesym, at_global_level);
 		return;
 	}
 
@@ -359,7 +414,7 @@ void typecheck_decl(ast_decl *decl, int at_global_level)
 	}
 
 	if (ts == NULL)
-		scope_bind_ts(decl->typesym);
+		bind_symbol(decl->typesym, at_global_level);
 
 	if (decl->typesym->type->kind == Y_FUNCTION) {
 		typecheck_fnbody(decl);
@@ -381,14 +436,13 @@ void typecheck_decl(ast_decl *decl, int at_global_level)
 		if (decl->typesym->type->kind == Y_POINTER && decl->typesym->type->subtype->kind == Y_CHAR
 				&& decl->expr->kind == E_STR_LIT) {
 			ast_expr *e;
-			decl->initializer = vect_init(decl->expr->string_literal->size);
+			decl->initializer = ast_vect_init(decl->expr->string_literal->size);
 			for (size_t i = 0 ; i < decl->initializer->capacity ; ++i) {
 				strvec *c = strvec_init(1);
 				strvec_append(c, decl->expr->string_literal->text[i]);
 				// TODO: replace 0s with NULL
 				e = expr_init(E_CHAR_LIT, 0, 0, 0, 0, 0, c);
 				e->type = type_init(Y_CHAR, NULL);
-				e->owns_type = 1;
 				vect_append(decl->initializer, e);
 			}
 			return;
@@ -427,6 +481,8 @@ static void typecheck_fncall(ast_expr *expr)
 		report_error_cur_line("Identifier '%s' does not refer to a function\n", expr->name->text);
 		return;
 	}
+	expr->is_global = fn_ts->is_global;
+	expr->slot = fn_ts->slot;
 	vect *decl_arglist = fn_ts->type->arglist;
 	vect *expr_arglist = expr->sub_exprs;
 	size_t i;
@@ -455,16 +511,37 @@ static void typecheck_fncall(ast_expr *expr)
 	expr->type = fn_ts->type->subtype;
 }
 
+static ast_expr *build_splat(ast_expr *ex, ast_type *vector)
+{
+	ast_expr *ret = expr_init(E_CAST, ex, NULL, 0, NULL, 0, NULL);
+	ret->type = vector->unqual;
+	return ret;
+}
+
+// A scalar next to a vector gets broadcast to all of its lanes, like in GCC's vector
+// extensions.
+static void splat_if_necessary(ast_expr *expr)
+{
+	ast_type *l = expr->left->type;
+	ast_type *r = expr->right->type;
+
+	if (is_vector_type(l) && is_int_type(r))
+		expr->right = build_splat(expr->right, l);
+	else if (is_vector_type(r) && is_int_type(l) && expr->kind != E_ASSIGN)
+		expr->left = build_splat(expr->left, r);
+}
+
 static void derive_assign(ast_expr *expr) {
+	derive_expr_type(expr->left);
 	if (!expr->left->is_lvalue) {
 		cant_with_expr("Cannot assign to non-lvalue expression", expr->left);
 		return;
 	}
-	derive_expr_type(expr->left);
 	if (expr->left->type != NULL && expr->left->type->modif != VM_DEFAULT) {
 		cant_with_expr("Cannot assign to const/proto value", expr->left);
 	}
 	derive_expr_type(expr->right);
+	splat_if_necessary(expr);
 	if (type_equals(expr->left->type, expr->right->type, 0)) {
 		expr->type = expr->left->type;
 		return;
@@ -480,6 +557,8 @@ static void derive_assign(ast_expr *expr) {
 
 static void derive_pre_unary(ast_expr *expr)
 {
+	ast_expr *base;
+	ast_typed_symbol *ts;
 	derive_expr_type(expr->left);
 	switch (expr->op) {
 	case T_AMPERSAND:
@@ -487,10 +566,17 @@ static void derive_pre_unary(ast_expr *expr)
 			cant_with_expr("Cannot find address of non-lvalue expr", expr->left);
 			return;
 		}
-		expr->type = type_init(expr->left->type->modif == VM_CONST ? Y_CONSTPTR : Y_POINTER, NULL);
-		expr->owns_type = true;
-		expr->type->subtype = expr->left->type;
-		expr->type->owns_subtype = false;
+		// Lanes are written through their vector, so they have no address of their own.
+		if (vector_lane(expr->left) != NULL) {
+			cant_with_expr("Cannot find address of vector lane", expr->left);
+			return;
+		}
+		expr->type = type_pointer(expr->left->type->modif == VM_CONST ? Y_CONSTPTR : Y_POINTER, expr->left->type);
+		// An element's address escapes along with the pointer that was indexed for it.
+		for (base = expr->left ; base->kind == E_PAREN || (base->kind == E_POST_UNARY && base->op == T_LBRACKET) ;)
+			base = base->left;
+		if (base->kind == E_IDENTIFIER && (ts = scope_lookup(base->name)) != NULL)
+			ts->escapes = 1;
 		break;
 	case T_STAR:
 		if (expr->left->type == NULL || (expr->left->type->kind != Y_POINTER && expr->left->type->kind != Y_CONSTPTR)) {
@@ -500,14 +586,14 @@ static void derive_pre_unary(ast_expr *expr)
 		expr->type = expr->left->type->subtype;
 		break;
 	case T_MINUS:
-		if (!is_int_type(expr->left->type)) {
+		if (!is_int_type(expr->left->type) && !is_vector_type(expr->left->type)) {
 			cant_with_expr("Cannot use unary negative operator on non-integer expression", expr->left);
 			return;
 		}
 		expr->type = expr->left->type;
 		break;
 	case T_BW_NOT:
-		if (!is_int_type(expr->left->type)) {
+		if (!is_int_type(expr->left->type) && !is_vector_type(expr->left->type)) {
 			cant_with_expr("Cannot use unary bitwise not operator on non-integer expression", expr->left);
 			return;
 		}
@@ -526,29 +612,61 @@ static void derive_pre_unary(ast_expr *expr)
 			return;
 		}
 		expr->type = type_init(Y_U64, NULL);
-		expr->owns_type = true;
 		break;
 	default:
 		report_error_cur_line("unsupported expr kind while typechecking!\n");
 	}
 }
 
-static ast_type *struct_field_type(ast_typed_symbol *struct_ts, strvec *name) {
-	vect *field_list = struct_ts->type->arglist;
-	ast_typed_symbol *cur;
-	for (size_t i = 0 ; i < field_list->size ; ++i) {
-		cur = arglist_get(field_list, i);
-		if (strvec_equals(name, cur->symbol))
-			return cur->type;
+static ast_type *struct_field_type(ast_typed_symbol *struct_ts, istr *name) {
+	struct_field *field = ht_get(struct_ts->type->fields, name);
+	return field == NULL ? NULL : field->type;
+}
+static ast_typed_symbol *derive_identifier(ast_expr *expr)
+{
+	ast_typed_symbol *ts = scope_lookup(expr->name);
+	if (ts == NULL) {
+		report_error_cur_line("Used undeclared identifier '%s'\n", expr->name->text);
+		return NULL;
+	}
+	if (ts->type->kind == Y_STRUCT && ts->type->name == expr->name) {
+		report_error_cur_line("Can't use struct type '%s' in this expression\n", ts->type->name->text);
+		return NULL;
 	}
-	return NULL;
+	expr->type = ts->type;
+	expr->is_global = ts->is_global;
+	expr->slot = ts->slot;
+	return ts;
 }
+
 static void derive_post_unary(ast_expr *expr)
 {
 	ast_typed_symbol *ts;
-	derive_expr_type(expr->left);
+	// Indexing a pointer doesn't let it escape, which codegen cares about for the
+	// arrays behind const pointers (see initializer_codegen).
+	if (expr->op == T_LBRACKET && expr->left->kind == E_IDENTIFIER)
+		derive_identifier(expr->left);
+	else
+		derive_expr_type(expr->left);
 	switch (expr->op) {
 	case T_LBRACKET:
+		// Vector lanes, which can only be assigned to if the vector can.
+		if (is_vector_type(expr->left->type)) {
+			derive_expr_type(expr->right);
+			if (expr->right->type == NULL || expr->right->type->kind != Y_I32) {
+				cant_with_expr("Cannot index with non-integer expression", expr->right);
+				return;
+			}
+			if (expr->right->kind == E_INT_LIT &&
+					(expr->right->num < 0 || expr->right->num >= expr->left->type->lanes)) {
+				report_error_cur_line("Lane index %ld is not from 0 to %u\n", (long)expr->right->num,
+						expr->left->type->lanes - 1);
+				return;
+			}
+			expr->type = expr->left->type->subtype;
+			expr->is_lvalue = expr->left->is_lvalue;
+			return;
+		}
 		if (expr->left->type == NULL || (expr->left->type->kind != Y_POINTER &&
 					expr->left->type->kind != Y_CONSTPTR)) {
 			cant_with_expr("Cannot use index operator on non-pointer expression", expr->left);
@@ -584,6 +702,99 @@ static void derive_post_unary(ast_expr *expr)
 }
 
 
+// Integers can be cast to vectors (which broadcasts them) and vectors to vectors with
+// the same number of lanes (which converts every lane).
+static void typecheck_vector_cast(ast_expr *expr)
+{
+	ast_type *from = expr->left->type;
+	ast_type *to = expr->type;
+
+	if (to->kind != Y_VECTOR || !is_int_type(to->subtype)
+			|| !(is_int_type(from) || (is_vector_type(from) && from->lanes == to->lanes))) {
+		report_error_cur_line("Cannot cast ");
+		e_type_print(from);
+		fprintf(stderr, " to ");
+		e_type_print(to);
+		fprintf(stderr, ". Only integers and vectors with the same number of lanes can be cast to vectors.\n");
+	}
+}
+
+static ast_expr *vector_op_arg(ast_expr *expr, size_t i)
+{
+	return expr->sub_exprs->elements[i];
+}
+
+// loadu(p, lanes) loads a vector from a pointer to its elements, storeu(p, v) stores one,
+// and neither needs the pointer to be aligned. shuffle(a, b, i...) picks lane i of a
+// and b's lanes put one after the other, for every (constant) i.
+static void derive_vector_op(ast_expr *expr)
+{
+	size_t nargs = expr->sub_exprs == NULL ? 0 : expr->sub_exprs->size;
+	ast_type *p;
+	ast_type *v;
+
+	for (size_t i = 0 ; i < nargs ; ++i) {
+		derive_expr_type(vector_op_arg(expr, i));
+		if (vector_op_arg(expr, i)->type == NULL)
+			return;
+	}
+	switch (expr->op) {
+	case T_LOADU:
+		if (nargs != 2) {
+			report_error_cur_line("loadu takes a pointer and a number of lanes\n");
+			return;
+		}
+		p = vector_op_arg(expr, 0)->type;
+		if ((p->kind != Y_POINTER && p->kind != Y_CONSTPTR) || !is_int_type(p->subtype)) {
+			cant_with_expr("Cannot load a vector from non-integer-pointer expression", vector_op_arg(expr, 0));
+			return;
+		}
+		if (vector_op_arg(expr, 1)->kind != E_INT_LIT || !valid_lanes(vector_op_arg(expr, 1)->num)) {
+			report_error_cur_line("loadu needs a constant power of two from 2 to 64 lanes\n");
+			return;
+		}
+		expr->type = type_vector(p->subtype->unqual, vector_op_arg(expr, 1)->num);
+		return;
+	case T_STOREU:
+		if (nargs != 2) {
+			report_error_cur_line("storeu takes a pointer and a vector\n");
+			return;
+		}
+		p = vector_op_arg(expr, 0)->type;
+		v = vector_op_arg(expr, 1)->type;
+		if (p->kind != Y_POINTER || v->kind != Y_VECTOR || p->subtype->unqual != v->subtype->unqual) {
+			report_error_cur_line("Mismatched types in storeu");
+			got_but_expected(p, type_pointer(Y_POINTER, v->kind == Y_VECTOR ? v->subtype : v));
+			return;
+		}
+		expr->type = type_init(Y_VOID, NULL);
+		return;
+	case T_SHUFFLE:
+		if (nargs < 4 || !valid_lanes(nargs - 2)) {
+			report_error_cur_line("shuffle takes two vectors and a power of two from 2 to 64 lane indices\n");
+			return;
+		}
+		v = vector_op_arg(expr, 0)->type;
+		if (!is_vector_type(v) || !type_equals(v, vector_op_arg(expr, 1)->type, 0)) {
+			l_r_mismatch("Operands must both be vectors of the same type in shuffle", vector_op_arg(expr, 0),
+					vector_op_arg(expr, 1));
+			return;
+		}
+		for (size_t i = 2 ; i < nargs ; ++i) {
+			ast_expr *lane = vector_op_arg(expr, i);
+			if (lane->kind != E_INT_LIT || lane->num < 0 || lane->num >= 2 * v->lanes) {
+				report_error_cur_line("Lane index %lu of shuffle is not a constant from 0 to %u\n", i - 2,
+						2 * v->lanes - 1);
+				return;
+			}
+		}
+		expr->type = type_vector(v->subtype->unqual, nargs - 2);
+		return;
+	default:
+		report_error_cur_line("unsupported vector builtin while typechecking\n");
+	}
+}
+
 static void cast_up_if_necessary(ast_expr *expr)
 {
 	ast_expr *l = expr->left;
@@ -629,7 +840,9 @@ void derive_expr_type(ast_expr *expr)
 		derive_expr_type(expr->left);
 		derive_expr_type(expr->right);
 		cast_up_if_necessary(expr);
-		if (type_equals(expr->left->type, expr->right->type, 0) && is_int_type(expr->left->type)) {
+		splat_if_necessary(expr);
+		if (type_equals(expr->left->type, expr->right->type, 0)
+				&& (is_int_type(expr->left->type) || is_vector_type(expr->left->type))) {
 			expr->type = expr->left->type;
 			return;
 		}
@@ -640,12 +853,18 @@ void derive_expr_type(ast_expr *expr)
 		derive_expr_type(expr->left);
 		derive_expr_type(expr->right);
 		cast_up_if_necessary(expr);
+		splat_if_necessary(expr);
+		// Comparing vectors compares lanes, each lane of the result is all ones if it
+		// holds and zero if not.
+		if (is_vector_type(expr->left->type) && type_equals(expr->left->type, expr->right->type, 0)) {
+			expr->type = expr->left->type->unqual;
+			return;
+		}
 		if ((is_int_type(expr->left->type) && is_int_type(expr->right->type)) ||
 					(expr->left->type != NULL && expr->right->type != NULL &&
 					expr->left->type->kind == Y_CHAR
 					&& expr->right->type->kind == Y_CHAR)) {
 			expr->type = type_init(Y_BOOL, NULL);
-			expr->owns_type = true;
 			return;
 		}
 		l_r_mismatch("Operands must both be integer types in (in)equality expressions", expr->left, expr->right);
@@ -659,40 +878,29 @@ void derive_expr_type(ast_expr *expr)
 		return;
 	case E_CHAR_LIT:
 		expr->type = type_init(Y_CHAR, NULL);
-		expr->owns_type = true;
 		return;
 	case E_TRUE_LIT:
 	case E_FALSE_LIT:
 		expr->type = type_init(Y_BOOL, NULL);
-		expr->owns_type = true;
 		return;
 	case E_NULL:
-		expr->type = type_init(Y_POINTER, NULL);
-		expr->type->subtype = type_init(Y_VOID, NULL);
-		expr->owns_type = true;
+		expr->type = type_pointer(Y_POINTER, type_init(Y_VOID, NULL));
 		return;
 	case E_INT_LIT:
 		// Deriving this type is performed in parsing.
 		return;
 	case E_STR_LIT:
-		expr->type = type_init(Y_CONSTPTR, NULL);
-		expr->type->subtype = type_init(Y_CHAR, NULL);
-		expr->owns_type = true;
+		expr->type = type_pointer(Y_CONSTPTR, type_init(Y_CHAR, NULL));
+		// Interned here rather than in codegen, whose -j parts share the interner.
+		expr->pooled = intern(expr->string_literal->text, expr->string_literal->size - 1);
 		return;
 	case E_FNCALL:
 		typecheck_fncall(expr);
 		return;
 	case E_IDENTIFIER:
-		ts = scope_lookup(expr->name);
-		if (ts == NULL) {
-			report_error_cur_line("Used undeclared identifier '%s'\n", expr->name->text);
-			return;
-		}
-		if (ts->type->kind == Y_STRUCT && ts->type->name != NULL && strvec_equals(ts->type->name, expr->name)) {
-			report_error_cur_line("Can't use struct type '%s' in this expression\n", ts->type->name);
-			return;
-		}
-		expr->type = ts->type;
+		ts = derive_identifier(expr);
+		if (ts != NULL)
+			ts->escapes = 1;
 		return;
 	case E_CAST:
 		if (expr->type->kind == Y_STRUCT) {
@@ -701,10 +909,15 @@ void derive_expr_type(ast_expr *expr)
 		}
 		derive_expr_type(expr->left);
 		// expr->type is already set during parsing.
+		if (is_vector_type(expr->type) || is_vector_type(expr->left->type))
+			typecheck_vector_cast(expr);
 		return;
 	case E_PRE_UNARY:
 		derive_pre_unary(expr);
 		return;
+	case E_VECTOR_OP:
+		derive_vector_op(expr);
+		return;
 	case E_POST_UNARY:
 		derive_post_unary(expr);
 		return;
@@ -753,7 +966,7 @@ void typecheck_asm(ast_stmt *stmt) {
 
 void typecheck_stmt(ast_stmt *stmt, int at_fn_top_level)
 {
-	int old_in_loop = in_loop;
+	int old_in_loop = cur_ctx->in_loop;
 	if (stmt == NULL) {
 		if (at_fn_top_level) {
 			report_error_cur_line("Non-void functions must end in valid return statements\n");
@@ -761,7 +974,7 @@ void typecheck_stmt(ast_stmt *stmt, int at_fn_top_level)
 		}
 		return;
 	}
-	cur_line = stmt->line;
+	cur_ctx->cur_line = stmt->line;
 	if (is_return_worthy(stmt) == RETW_TRUE) {
 		if (stmt->next != NULL) {
 			report_error_cur_line("Return-worthy statements must appear at the end of fn blocks.\n"); // TODO: this is a bad error messsage
@@ -798,18 +1011,39 @@ void typecheck_stmt(ast_stmt *stmt, int at_fn_top_level)
 		derive_expr_type(stmt->expr);
 		if (stmt->expr->type == NULL || stmt->expr->type->kind != Y_BOOL)
 			cant_with_expr("Could not use non-boolean while statement condition", stmt->expr);
-		in_loop = 1;
+		cur_ctx->in_loop = 1;
 		if (stmt->body != NULL) {
 			typecheck_stmt(stmt->body->body, 0);
 		} else {
 			report_error_cur_line("Empty while loop body.\n");
 		}
-		in_loop = old_in_loop;
+		cur_ctx->in_loop = old_in_loop;
+		typecheck_stmt(stmt->next, at_fn_top_level);
+		break;
+	case S_FOR:
+		// The init's declaration is only visible in the loop.
+		scope_enter();
+		typecheck_stmt(stmt->for_obj->init, 0);
+		cur_ctx->cur_line = stmt->line;
+		if (stmt->expr != NULL) {
+			derive_expr_type(stmt->expr);
+			if (stmt->expr->type == NULL || stmt->expr->type->kind != Y_BOOL)
+				cant_with_expr("Could not use non-boolean for statement condition", stmt->expr);
+		}
+		derive_expr_type(stmt->for_obj->step);
+		cur_ctx->in_loop = 1;
+		if (stmt->body != NULL) {
+			typecheck_stmt(stmt->body->body, 0);
+		} else {
+			report_error_cur_line("Empty for loop body.\n");
+		}
+		cur_ctx->in_loop = old_in_loop;
+		scope_exit();
 		typecheck_stmt(stmt->next, at_fn_top_level);
 		break;
 	case S_BREAK:
 	case S_CONTINUE:
-		if (!in_loop) {
+		if (!cur_ctx->in_loop) {
 			report_error_cur_line("Break/continue statement used outside of loop\n");
 		}
 		if (stmt->next != NULL) {
@@ -841,34 +1075,20 @@ void typecheck_stmt(ast_stmt *stmt, int at_fn_top_level)
 	}
 }
 
-static int arglist_equals(vect *a, vect *b)
-{
-	size_t i;
-	ast_typed_symbol *at;
-	ast_typed_symbol *bt;
-	if (a == NULL && b == NULL)
-		return 1;
-	if (a == NULL || b == NULL)
-		return 0;
-	if (a->size != b->size)
-		return 0;
-	for (i = 0 ; i < a->size ; ++i) {
-		at = arglist_get(a, i);
-		bt = arglist_get(b, i);
-		if (!type_equals(at->type, bt->type, 1))
-			return 0;
-	}
-	return 1;
-}
-
+// Two types are equal if they only differ in modifiers and argument names. Unless
+// int_type_strict is set, integer types of the same width (and pointers to them) are
+// interchangeable too.
 int type_equals(ast_type *a, ast_type *b, int int_type_strict)
 {
-	if (a == NULL && b == NULL)
-		return 1;
 	if (a == NULL || b == NULL)
+		return a == b;
+	if (a->unqual == b->unqual)
+		return 1;
+	if (int_type_strict)
 		return 0;
-	// TODO: clean this up
-	return type_equals(a->subtype, b->subtype, int_type_strict) && arglist_equals(a->arglist, b->arglist) &&
-			(a->kind == b->kind ||
-			(!int_type_strict && (is_int_type(a) && is_int_type(b) && TYPE_WIDTH(a->kind) == TYPE_WIDTH(b->kind))));
+	if (is_int_type(a) && is_int_type(b))
+		return TYPE_WIDTH(a->kind) == TYPE_WIDTH(b->kind);
+	if ((a->kind == Y_POINTER || a->kind == Y_CONSTPTR) && a->kind == b->kind)
+		return type_equals(a->subtype, b->subtype, 0);
+	return 0;
 }
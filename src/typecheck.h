@@ -2,8 +2,9 @@
 #define TYPECHECK_H
 
 #include "ast.h"
+#include "compiler.h"
 
-void typecheck_program(ast_decl *program);
+void typecheck_program(compile_ctx *c, ast_decl *program);
 void typecheck_decl(ast_decl *decl, int at_global_level);
 void derive_expr_type(ast_expr *expr);
 void typecheck_stmt(ast_stmt *stmt, int at_fn_top_level);
@@ -0,0 +1,224 @@
+#include "ast.h"
+#include "compiler.h"
+#include "ht.h"
+#include "types.h"
+#include "util.h"
+
+struct type_table {
+	ast_type **slots;
+	size_t capacity;
+	size_t num_elements;
+};
+
+struct type_table *types_init(void)
+{
+	struct type_table *ret = smalloc(sizeof(*ret));
+	ret->capacity = 256;
+	ret->num_elements = 0;
+	ret->slots = scalloc(ret->capacity, sizeof(*ret->slots));
+	return ret;
+}
+
+void types_destroy(struct type_table *types)
+{
+	if (types == NULL)
+		return;
+	free(types->slots);
+	free(types);
+}
+
+static uint64_t mix(uint64_t h, uint64_t v)
+{
+	h ^= v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+	return h;
+}
+
+// Subtypes and argument types are interned before the types built from them, so
+// everything below can be compared and hashed by pointer.
+static uint64_t type_hash(ast_type *t)
+{
+	uint64_t h = mix(t->kind, t->modif);
+	h = mix(h, (uintptr_t)t->name);
+	h = mix(h, (uintptr_t)t->subtype);
+	h = mix(h, t->lanes);
+	if (t->arglist == NULL)
+		return h;
+	h = mix(h, t->arglist->size + 1);
+	for (size_t i = 0 ; i < t->arglist->size ; ++i) {
+		ast_typed_symbol *ts = arglist_get(t->arglist, i);
+		if (ts == NULL)
+			continue;
+		h = mix(h, (uintptr_t)ts->symbol);
+		h = mix(h, (uintptr_t)ts->type);
+	}
+	return h;
+}
+
+static int arglist_same(vect *a, vect *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	if (a->size != b->size)
+		return 0;
+	for (size_t i = 0 ; i < a->size ; ++i) {
+		ast_typed_symbol *at = arglist_get(a, i);
+		ast_typed_symbol *bt = arglist_get(b, i);
+		if (at == NULL || bt == NULL) {
+			if (at != bt)
+				return 0;
+		} else if (at->symbol != bt->symbol || at->type != bt->type) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int type_same(ast_type *a, ast_type *b)
+{
+	return a->hash == b->hash && a->kind == b->kind && a->modif == b->modif && a->name == b->name
+			&& a->subtype == b->subtype && a->lanes == b->lanes && arglist_same(a->arglist, b->arglist);
+}
+
+static void grow(struct type_table *types)
+{
+	size_t new_cap = types->capacity * 2;
+	ast_type **new_slots = scalloc(new_cap, sizeof(*new_slots));
+	for (size_t i = 0 ; i < types->capacity ; ++i) {
+		ast_type *t = types->slots[i];
+		if (t == NULL)
+			continue;
+		size_t index = t->hash & (new_cap - 1);
+		while (new_slots[index] != NULL)
+			index = (index + 1) & (new_cap - 1);
+		new_slots[index] = t;
+	}
+	free(types->slots);
+	types->slots = new_slots;
+	types->capacity = new_cap;
+}
+
+static int is_unqualified(ast_type *t)
+{
+	if (t->modif != VM_DEFAULT || (t->subtype != NULL && t->subtype->unqual != t->subtype))
+		return 0;
+	for (size_t i = 0 ; t->arglist != NULL && i < t->arglist->size ; ++i) {
+		ast_typed_symbol *ts = arglist_get(t->arglist, i);
+		if (ts != NULL && (ts->symbol != NULL || ts->type->unqual != ts->type))
+			return 0;
+	}
+	return 1;
+}
+
+static void fields_cleanup(void *fields)
+{
+	ht_destroy_embedded(fields);
+}
+
+// Struct definitions get their fields indexed by name once, up front, so member accesses
+// don't have to search the field list.
+static struct ht *index_fields(vect *arglist)
+{
+	struct ht *ret = ast_alloc(sizeof(*ret));
+	struct_field *fields = ast_alloc(arglist->size * sizeof(*fields));
+	ht_init_embedded(ret, arglist->size * 2, NULL);
+	arena_defer(cur_ctx->ast_arena, fields_cleanup, ret);
+	for (size_t i = 0 ; i < arglist->size ; ++i) {
+		ast_typed_symbol *ts = arglist_get(arglist, i);
+		if (ts == NULL || ts->symbol == NULL)
+			continue;
+		fields[i].type = ts->type;
+		fields[i].pos = i;
+		ht_insert(ret, ts->symbol, &fields[i]);
+	}
+	return ret;
+}
+
+static ast_type *intern_type(ast_type *key)
+{
+	struct type_table *types = cur_ctx->types;
+	ast_type *t;
+	size_t index;
+
+	key->hash = type_hash(key);
+	index = key->hash & (types->capacity - 1);
+	while ((t = types->slots[index]) != NULL) {
+		if (type_same(t, key))
+			return t;
+		index = (index + 1) & (types->capacity - 1);
+	}
+
+	t = ast_alloc(sizeof(*t));
+	*t = *key;
+	t->unqual = t;
+	if (t->kind == Y_STRUCT && t->arglist != NULL)
+		t->fields = index_fields(t->arglist);
+	if (!is_unqualified(t)) {
+		ast_type unqual = *key;
+		unqual.modif = VM_DEFAULT;
+		unqual.subtype = key->subtype == NULL ? NULL : key->subtype->unqual;
+		if (key->arglist != NULL) {
+			unqual.arglist = ast_vect_init(key->arglist->size);
+			for (size_t i = 0 ; i < key->arglist->size ; ++i) {
+				ast_typed_symbol *ts = arglist_get(key->arglist, i);
+				vect_append(unqual.arglist, ts == NULL ? NULL : ast_typed_symbol_init(ts->type->unqual, NULL));
+			}
+		}
+		t->unqual = intern_type(&unqual);
+	}
+
+	// Interning the unqualified type might have moved things around.
+	if (types->num_elements >= types->capacity * 3 / 4)
+		grow(types);
+	index = t->hash & (types->capacity - 1);
+	while (types->slots[index] != NULL)
+		index = (index + 1) & (types->capacity - 1);
+	types->slots[index] = t;
+	types->num_elements++;
+	return t;
+}
+
+static ast_type *build(type_t kind, istr *name, ast_type *subtype, vect *arglist, value_modifier_t modif,
+		uint32_t lanes)
+{
+	ast_type key;
+	key.subtype = subtype;
+	key.arglist = arglist;
+	key.kind = kind;
+	key.name = name;
+	key.modif = modif;
+	key.fields = NULL;
+	key.lanes = lanes;
+	return intern_type(&key);
+}
+
+ast_type *type_init(type_t kind, istr *name)
+{
+	return build(kind, name, NULL, NULL, VM_DEFAULT, 0);
+}
+
+ast_type *type_pointer(type_t kind, ast_type *subtype)
+{
+	return build(kind, NULL, subtype, NULL, VM_DEFAULT, 0);
+}
+
+ast_type *type_function(ast_type *ret, vect *arglist)
+{
+	return build(Y_FUNCTION, NULL, ret, arglist, VM_DEFAULT, 0);
+}
+
+ast_type *type_vector(ast_type *elem, uint32_t lanes)
+{
+	return build(Y_VECTOR, NULL, elem, NULL, VM_DEFAULT, lanes);
+}
+
+ast_type *type_struct_def(vect *fields)
+{
+	return build(Y_STRUCT, NULL, NULL, fields, VM_DEFAULT, 0);
+}
+
+ast_type *type_qualify(ast_type *t, value_modifier_t modif)
+{
+	if (t == NULL || t->modif == modif)
+		return t;
+	return build(t->kind, t->name, t->subtype, t->arglist, modif, t->lanes);
+}
@@ -0,0 +1,25 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "ast.h"
+
+// Types are hash-consed: there is exactly one ast_type for every distinct (kind, name,
+// subtype, arglist, modif, lanes) in a compilation. Never modify a type once it's been
+// built, build the one you want instead (e.g. with type_qualify).
+//
+// Every type also points to its unqualified version (no modifiers anywhere, no argument
+// names), so two types are the same type if and only if their unquals are the same pointer.
+struct type_table;
+
+// Interning goes through the current compilation's type table (see compiler.h).
+struct type_table *types_init(void);
+void types_destroy(struct type_table *types);
+
+ast_type *type_init(type_t kind, istr *name);
+ast_type *type_pointer(type_t kind, ast_type *subtype);
+ast_type *type_function(ast_type *ret, vect *arglist);
+ast_type *type_vector(ast_type *elem, uint32_t lanes);
+ast_type *type_struct_def(vect *fields);
+ast_type *type_qualify(ast_type *t, value_modifier_t modif);
+
+#endif
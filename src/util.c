@@ -65,9 +65,13 @@ strvec *strvec_init(size_t capacity)
 }
 
 strvec *strvec_init_str(const char *str)
+{
+	return strvec_init_slice(str, strlen(str));
+}
+
+strvec *strvec_init_slice(const char *str, size_t len)
 {
 	strvec *ret = smalloc(sizeof(*ret));
-	size_t len = strlen(str);
 	ret->capacity = len + 1;
 	ret->size = ret->capacity;
 	ret->text = smalloc(ret->capacity);
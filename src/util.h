@@ -27,6 +27,7 @@ void *srealloc(void *ptr, size_t size);
 strvec *strvec_init(size_t capacity);
 strvec *strvec_copy(strvec *s);
 strvec *strvec_init_str(const char *str);
+strvec *strvec_init_slice(const char *str, size_t len);
 void strvec_append(strvec *vec, char c);
 int strvec_equals(strvec *a, strvec *b);
 void fstrvec_print(FILE *f, strvec *vec);